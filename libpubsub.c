@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "libpubsub.h"
+
+#define DEFAULT_RX (64 * 1024)
+
+struct ps_client {
+    int fd;
+    int framed; // set through ps_set_framed: batches would merge records
+    // publish batch
+    char *batch;
+    size_t batch_cap; // 0 while batching is off
+    size_t batch_len;
+    unsigned int flush_ms;
+    long long batch_since; // ms, when the oldest batched byte came in
+    // records read ahead by ps_next
+    char *rx;
+    size_t rx_cap;
+    size_t rx_len;
+    size_t rx_pos;
+    int read_framed;
+};
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// ioctl that returns 0 or -1
+static int ps_ioctl(struct ps_client *c, unsigned long cmd, unsigned long arg)
+{
+    return ioctl(c->fd, cmd, arg) < 0 ? -1 : 0;
+}
+
+struct ps_client *ps_open(const char *path, int type)
+{
+    struct ps_client *c = calloc(1, sizeof(*c));
+
+    if (c == NULL) {
+        return NULL;
+    }
+    c->fd = open(path, O_RDWR);
+    if (c->fd < 0) {
+        free(c);
+        return NULL;
+    }
+    if (type != TYPE_NONE && ps_ioctl(c, SET_TYPE, type)) {
+        int err = errno;
+        close(c->fd);
+        free(c);
+        errno = err;
+        return NULL;
+    }
+    c->rx_cap = DEFAULT_RX;
+    return c;
+}
+
+int ps_close(struct ps_client *c)
+{
+    int ret = ps_flush(c);
+    int err = errno;
+
+    close(c->fd);
+    free(c->batch);
+    free(c->rx);
+    free(c);
+    errno = err;
+    return ret;
+}
+
+int ps_fd(struct ps_client *c)
+{
+    return c->fd;
+}
+
+int ps_set_framed(struct ps_client *c, int framed)
+{
+    if (framed && c->batch_cap > 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ps_ioctl(c, SET_FRAMED, framed)) {
+        return -1;
+    }
+    c->framed = framed;
+    return 0;
+}
+
+int ps_set_priority(struct ps_client *c, int lane)
+{
+    return ps_ioctl(c, SET_PRIORITY, lane);
+}
+
+int ps_set_key(struct ps_client *c, unsigned int key)
+{
+    return ps_ioctl(c, SET_KEY, key);
+}
+
+int ps_set_blocking(struct ps_client *c, int blocking)
+{
+    return ps_ioctl(c, SET_BLOCKING, blocking);
+}
+
+int ps_set_lanes(struct ps_client *c, int nr_lanes)
+{
+    return ps_ioctl(c, SET_LANES, nr_lanes);
+}
+
+int ps_set_capacity(struct ps_client *c, int bytes)
+{
+    return ps_ioctl(c, SET_CAPACITY, bytes);
+}
+
+int ps_set_retention(struct ps_client *c, unsigned int max_bytes, unsigned int max_records,
+                     unsigned int max_age_ms)
+{
+    struct pubsub_retention r;
+
+    r.max_bytes = max_bytes;
+    r.max_records = max_records;
+    r.max_age_ms = max_age_ms;
+    return ps_ioctl(c, SET_RETENTION, (unsigned long) &r);
+}
+
+int ps_join_group(struct ps_client *c, const char *name, int durable)
+{
+    return ps_ioctl(c, durable ? JOIN_DURABLE : JOIN_GROUP, (unsigned long) name);
+}
+
+int ps_subscribe_multi(struct ps_client *c, const unsigned int *minors, int nr_minors, int order)
+{
+    struct pubsub_merge m;
+
+    if (nr_minors < 1 || nr_minors > MAX_TARGETS) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset(&m, 0, sizeof(m));
+    m.order = order;
+    m.nr_minors = nr_minors;
+    memcpy(m.minors, minors, nr_minors * sizeof(minors[0]));
+    return ps_ioctl(c, SUBSCRIBE_MULTI, (unsigned long) &m);
+}
+
+int ps_set_batch(struct ps_client *c, size_t bytes, unsigned int flush_ms)
+{
+    char *batch = NULL;
+
+    if (bytes > 0 && c->framed) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ps_flush(c)) {
+        return -1;
+    }
+    if (bytes > 0) {
+        batch = malloc(bytes);
+        if (batch == NULL) {
+            return -1;
+        }
+    }
+    free(c->batch);
+    c->batch = batch;
+    c->batch_cap = bytes;
+    c->flush_ms = flush_ms;
+    return 0;
+}
+
+int ps_flush(struct ps_client *c)
+{
+    if (c->batch_len == 0) {
+        return 0;
+    }
+    // the driver takes a record whole or not at all
+    if (write(c->fd, c->batch, c->batch_len) < 0) {
+        return -1;
+    }
+    c->batch_len = 0;
+    return 0;
+}
+
+int ps_flush_timeout(struct ps_client *c)
+{
+    long long left;
+
+    if (c->batch_len == 0) {
+        return -1;
+    }
+    left = c->batch_since + c->flush_ms - now_ms();
+    return left > 0 ? (int) left : 0;
+}
+
+int ps_flush_expired(struct ps_client *c)
+{
+    if (c->batch_len > 0 && ps_flush_timeout(c) == 0) {
+        return ps_flush(c);
+    }
+    return 0;
+}
+
+int ps_publish(struct ps_client *c, const void *buf, size_t len)
+{
+    if (c->batch_cap == 0 || len > c->batch_cap) {
+        if (ps_flush(c)) {
+            return -1;
+        }
+        return write(c->fd, buf, len) < 0 ? -1 : 0;
+    }
+    if (c->batch_len + len > c->batch_cap && ps_flush(c)) {
+        return -1;
+    }
+    if (c->batch_len == 0) {
+        c->batch_since = now_ms();
+    }
+    memcpy(c->batch + c->batch_len, buf, len);
+    c->batch_len += len;
+    if (c->batch_len == c->batch_cap) {
+        // a full batch that cannot go out yet is still published later
+        if (ps_flush(c) && errno != EAGAIN) {
+            return -1;
+        }
+        return 0;
+    }
+    return ps_flush_expired(c) && errno != EAGAIN ? -1 : 0;
+}
+
+int ps_publish_zc(struct ps_client *c, const void *buf, size_t len)
+{
+    struct pubsub_zc zc;
+
+    if (ps_flush(c)) {
+        return -1;
+    }
+    zc.buf = buf;
+    zc.len = len;
+    return ps_ioctl(c, PUBLISH_ZC, (unsigned long) &zc);
+}
+
+int ps_zc_done(struct ps_client *c)
+{
+    return ioctl(c->fd, GET_ZC_DONE);
+}
+
+int ps_wait(struct ps_client *c, int timeout_ms)
+{
+    struct pollfd p;
+    int ret;
+
+    if (c->rx_pos < c->rx_len) {
+        return 1;
+    }
+    p.fd = c->fd;
+    p.events = POLLIN;
+    ret = poll(&p, 1, timeout_ms);
+    if (ret < 0) {
+        return -1;
+    }
+    return ret > 0 && (p.revents & POLLIN);
+}
+
+ssize_t ps_read(struct ps_client *c, void *buf, size_t len)
+{
+    return read(c->fd, buf, len);
+}
+
+int ps_set_rx(struct ps_client *c, size_t bytes)
+{
+    char *rx;
+
+    if (bytes < sizeof(struct pubsub_frame) || c->rx_pos < c->rx_len) {
+        errno = EINVAL;
+        return -1;
+    }
+    rx = realloc(c->rx, bytes);
+    if (rx == NULL) {
+        return -1;
+    }
+    c->rx = rx;
+    c->rx_cap = bytes;
+    return 0;
+}
+
+ssize_t ps_next(struct ps_client *c, struct pubsub_frame *frame, const void **payload)
+{
+    if (c->rx_pos == c->rx_len) {
+        ssize_t n;
+
+        if (c->rx == NULL && ps_set_rx(c, c->rx_cap)) {
+            return -1;
+        }
+        if (!c->read_framed) {
+            if (ps_ioctl(c, SET_READ_FRAMED, 1)) {
+                return -1;
+            }
+            c->read_framed = 1;
+        }
+        // one read brings in every record that fits
+        n = read(c->fd, c->rx, c->rx_cap);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        c->rx_len = n;
+        c->rx_pos = 0;
+    }
+    memcpy(frame, c->rx + c->rx_pos, sizeof(*frame));
+    *payload = c->rx + c->rx_pos + sizeof(*frame);
+    c->rx_pos += sizeof(*frame) + frame->len;
+    return frame->len;
+}
@@ -0,0 +1,72 @@
+#ifndef _LIBPUBSUB_H_
+#define _LIBPUBSUB_H_
+
+// Userspace client of the pubsub driver. It wraps the ioctls of pubsub.h so
+// applications (and pubsub_client.py through ctypes) never encode them, and
+// adds the two things every client used to hand-roll:
+//
+// - buffered publishing: small publishes to a raw minor are coalesced into
+//   one write, sent once the batch is full or its flush deadline passed;
+// - record reads: a framed subscriber reads as many records as fit in its
+//   receive buffer with one read, then hands them out without syscalls.
+//
+// Functions return 0 (or a count) on success and -1 with errno set on error.
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "pubsub.h"
+
+struct ps_client;
+
+// Open the device node as a file of the given type (TYPE_PUB, TYPE_SUB,
+// TYPE_GROUP, or TYPE_NONE to set it up later, e.g. with ps_subscribe_multi).
+struct ps_client *ps_open(const char *path, int type);
+// Flushes what is still batched, then closes the file.
+int ps_close(struct ps_client *c);
+int ps_fd(struct ps_client *c);
+
+// The per-file and per-minor settings, see pubsub.h.
+int ps_set_framed(struct ps_client *c, int framed);
+int ps_set_priority(struct ps_client *c, int lane);
+int ps_set_key(struct ps_client *c, unsigned int key);
+int ps_set_blocking(struct ps_client *c, int blocking);
+int ps_set_lanes(struct ps_client *c, int nr_lanes);
+int ps_set_capacity(struct ps_client *c, int bytes);
+int ps_set_retention(struct ps_client *c, unsigned int max_bytes, unsigned int max_records,
+                     unsigned int max_age_ms);
+int ps_join_group(struct ps_client *c, const char *name, int durable);
+int ps_subscribe_multi(struct ps_client *c, const unsigned int *minors, int nr_minors, int order);
+
+// Publish len bytes. Without a batch they are written at once; with one they
+// are appended to it, and the batch is written when it would overflow or its
+// deadline passed. A batch that cannot be written yet (EAGAIN) is kept.
+int ps_publish(struct ps_client *c, const void *buf, size_t len);
+// Batch up to bytes (0 turns batching off) for at most flush_ms. Batches are
+// one record to the driver, so only raw minors can batch.
+int ps_set_batch(struct ps_client *c, size_t bytes, unsigned int flush_ms);
+int ps_flush(struct ps_client *c);
+// Flush if the deadline passed: for event loops that publish rarely.
+int ps_flush_expired(struct ps_client *c);
+// ms until the batch has to be flushed, -1 when nothing is batched.
+int ps_flush_timeout(struct ps_client *c);
+
+// PUBLISH_ZC: buf must stay untouched until ps_zc_done counts it.
+int ps_publish_zc(struct ps_client *c, const void *buf, size_t len);
+int ps_zc_done(struct ps_client *c);
+
+// Wait up to timeout_ms (-1 for ever) for the file to be readable. Returns 1
+// when it is, 0 on timeout. Records already received count as readable.
+int ps_wait(struct ps_client *c, int timeout_ms);
+// Plain read of a subscriber: the bytes of a raw minor, or the payloads of a
+// framed one. Not to be mixed with ps_next.
+ssize_t ps_read(struct ps_client *c, void *buf, size_t len);
+// The next record of a framed minor: its header goes to *frame and *payload
+// points at it until the next call. Returns the payload length; -1 with
+// EAGAIN when there is nothing to read.
+ssize_t ps_next(struct ps_client *c, struct pubsub_frame *frame, const void **payload);
+// Size of the buffer ps_next reads into (64KB by default); records larger
+// than it cannot be read.
+int ps_set_rx(struct ps_client *c, size_t bytes);
+
+#endif
@@ -2,18 +2,52 @@
  *
  */
 /* Kernel Programming */
+#ifndef MODULE
 #define MODULE
+#endif
 #define LINUX
+#ifndef __KERNEL__
 #define __KERNEL__
+#endif
+
+#include <linux/version.h>
+
+// The module builds with plain gcc against the 2.4 headers it was written for,
+// and with kbuild against current kernels (make modern). Whatever differs
+// between the two lives in PUBSUB_MODERN blocks.
+#define PUBSUB_MODERN (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
 
 #include <linux/kernel.h>  	
 #include <linux/module.h>
 #include <linux/fs.h>       		
-#include <asm/uaccess.h>
 #include <linux/errno.h>  
-#include <asm/segment.h>
 #include <asm/current.h>
 #include<linux/slab.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/proc_fs.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/time.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/capability.h>
+#if PUBSUB_MODERN
+#include <linux/uaccess.h>
+#include <linux/semaphore.h>
+#include <linux/moduleparam.h>
+#include <linux/highmem.h>
+#include <linux/uio.h>
+#include <linux/seq_file.h>
+#include <linux/compat.h>
+#include <linux/workqueue.h>
+#include <linux/sched/signal.h>
+#else
+#include <linux/tqueue.h>
+#include <asm/uaccess.h>
+#include <asm/segment.h>
+#include <asm/semaphore.h>
+#endif
 
 #include "pubsub.h"
 
@@ -22,262 +56,4084 @@
 MODULE_AUTHOR("Anonymous");
 MODULE_LICENSE("GPL");
 
+#if PUBSUB_MODERN
+#define init_MUTEX(sem) sema_init(sem, 1)
+#define pubsub_param(name, type, type_2_4) module_param(name, type, 0444)
+#define zc_unpin_page(page) unpin_user_page(page)
+#define journal_file_size(f) i_size_read(file_inode(f))
+#define del_timer_sync(timer) timer_delete_sync(timer)
+#define schedule_pubsub_work(work) schedule_work(work)
+#define stage_cpu() raw_smp_processor_id() // a publisher that migrates just stages on the old CPU
+#define nr_stages() nr_cpu_ids
+#define pubsub_need_resched() need_resched()
+#define buff_kmalloc(size, node) kmalloc_node(size, GFP_KERNEL, node)
+#define node_valid(node) ((node) >= 0 && (node) < nr_node_ids && node_online(node))
+#else
+#define schedule_pubsub_work(work) schedule_task(work)
+#define stage_cpu() smp_processor_id()
+#define nr_stages() smp_num_cpus
+#define pubsub_need_resched() (current->need_resched)
+// 2.4 has no kmalloc_node: only page backed buffers are placed on a node
+#define buff_kmalloc(size, node) kmalloc(size, GFP_KERNEL)
+#define node_valid(node) ((node) >= 0 && (node) < numnodes)
+#ifndef numa_node_id
+#define numa_node_id() 0
+#endif
+#define pubsub_param(name, type, type_2_4) MODULE_PARM(name, type_2_4)
+#define zc_unpin_page(page) page_cache_release(page)
+#define journal_file_size(f) ((f)->f_dentry->d_inode->i_size)
+// at most one message every 5 seconds from each call site
+#define printk_ratelimited(fmt...) \
+    do { \
+        static unsigned long last_printk; \
+        if (last_printk == 0 || time_after(jiffies, last_printk + 5 * HZ)) { \
+            last_printk = jiffies; \
+            printk(fmt); \
+        } \
+    } while (0)
+#endif
+
 #define MINOR_NUM 256
 #define BUFFER_SIZE 1000
+#define MAX_GROUPS 8
+#define KMALLOC_MAX_BUFF (4 * PAGE_SIZE) // larger topic buffers are built from pages
+#define MAX_CHUNK_ORDER 4 // largest page order tried for a page backed buffer
+#define MAX_ZC_PAGES 256 // largest record PUBLISH_ZC pins, in pages
+#define MAX_NODES 8 // NUMA nodes a minor can be placed on and /proc/pubsub counts
+#define MAX_SPIN_US 10000 // longest SET_SPIN
+#define TRACE_ENTRIES 256 // events /proc/pubsub_trace keeps
+#define FRAME_ZC 0x80000000 // set in a stored frame's len when the payload is a pinned zc_record
+#define MAX_MULTI_LEN (MAX_ZC_PAGES * PAGE_SIZE) // largest PUBLISH_MULTI payload
+#define MAX_BOUNCE_LEN (MAX_ZC_PAGES * PAGE_SIZE) // largest readv/writev or registered buffer transfer
 
 /* globals */
 int my_major = 0; /* will hold the major # of my device driver */
+
+// Bytes of topic buffers all minors together may hold, 0 for no limit.
+static long mem_budget = 0;
+pubsub_param(mem_budget, long, "l");
+MODULE_PARM_DESC(mem_budget, "bytes of buffer memory all minors may pin, 0 = unlimited");
+static long mem_used = 0;
+static int node_buffers[MAX_NODES]; // topic buffers on each node, under budget_lock
+#if PUBSUB_MODERN
+static DEFINE_SPINLOCK(budget_lock);
+#else
+static spinlock_t budget_lock = SPIN_LOCK_UNLOCKED;
+#endif
+
+// Seconds a durable subscription nobody has open keeps its place in a minor.
+static int durable_retention = 60;
+pubsub_param(durable_retention, int, "i");
+MODULE_PARM_DESC(durable_retention, "seconds a detached durable subscription is retained");
+
+// Directory holding the journal of every minor switched on with SET_PERSIST.
+static char *persist_dir = "/var/lib/pubsub";
+pubsub_param(persist_dir, charp, "s");
+MODULE_PARM_DESC(persist_dir, "directory of the journals of persistent minors");
+
+#if PUBSUB_MODERN
+// per cpu trace buffers, nothing shared between the CPUs that trace
+#define CREATE_TRACE_POINTS
+#include "pubsub_trace.h"
+
+// A trace point: the tracepoint of the event, enabled in tracefs. event is a
+// constant at every site, so only that tracepoint's static key stays on the
+// fast path.
+#define pubsub_trace(event, minor, type, value, seek, resets, arg) \
+    do { \
+        switch (event) { \
+        case TRACE_OPEN: trace_pubsub_open(minor, type, value, seek, resets, arg); break; \
+        case TRACE_RELEASE: trace_pubsub_release(minor, type, value, seek, resets, arg); break; \
+        case TRACE_READ: trace_pubsub_read(minor, type, value, seek, resets, arg); break; \
+        case TRACE_WRITE: trace_pubsub_write(minor, type, value, seek, resets, arg); break; \
+        case TRACE_IOCTL: trace_pubsub_ioctl(minor, type, value, seek, resets, arg); break; \
+        case TRACE_RESET: trace_pubsub_reset(minor, type, value, seek, resets, arg); break; \
+        default: trace_pubsub_eagain(minor, type, value, seek, resets, arg); break; \
+        } \
+    } while (0)
+#else
+// Events the ring records, see SET_TRACE. Off by default.
+static unsigned int trace_mask = 0;
+pubsub_param(trace_mask, uint, "i");
+MODULE_PARM_DESC(trace_mask, "mask of the TRACE_x events /proc/pubsub_trace records");
+
+struct trace_entry {
+    unsigned long when; // jiffies
+    int event;
+    int minor;
+    int type; // of the file, TYPE_NONE for events of the minor itself
+    int value;
+    int seek; // lane fill or cursor position the event saw
+    int resets; // the lane's global_reset
+    unsigned long arg;
+};
+
+// the last TRACE_ENTRIES events, oldest at trace_next % TRACE_ENTRIES once full
+static struct trace_entry trace_ring[TRACE_ENTRIES];
+static unsigned long trace_next = 0;
+static spinlock_t trace_lock = SPIN_LOCK_UNLOCKED;
+
+static void trace_event(int event, int minor, int type, int value, int seek, int resets, unsigned long arg)
+{
+    struct trace_entry *t;
+
+    spin_lock_bh(&trace_lock);
+    t = &trace_ring[trace_next++ % TRACE_ENTRIES];
+    t->when = jiffies;
+    t->event = event;
+    t->minor = minor;
+    t->type = type;
+    t->value = value;
+    t->seek = seek;
+    t->resets = resets;
+    t->arg = arg;
+    spin_unlock_bh(&trace_lock);
+}
+
+// A trace point: only the mask test stays on the fast path while it is off.
+#define pubsub_trace(event, minor, type, value, seek, resets, arg) \
+    do { \
+        if (unlikely(trace_mask & (1 << (event)))) { \
+            trace_event(event, minor, type, value, seek, resets, arg); \
+        } \
+    } while (0)
+#endif
+
+#if PUBSUB_MODERN
+static ssize_t my_read_iter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t my_write_iter(struct kiocb *iocb, struct iov_iter *from);
+static long my_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+#ifdef CONFIG_COMPAT
+static long my_compat_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+#endif
+#endif
+
 struct file_operations my_fops = {
     .open = my_open,
     .release = my_release,
+#if PUBSUB_MODERN
+    .owner = THIS_MODULE,
+    .read_iter = my_read_iter,
+    .write_iter = my_write_iter,
+    .unlocked_ioctl = my_unlocked_ioctl,
+#ifdef CONFIG_COMPAT
+    .compat_ioctl = my_compat_ioctl,
+#endif
+#else
     .read = my_read,
 	.write = my_write,
     .ioctl = my_ioctl,
+#endif
+    .poll = my_poll,
+};
+
+
+// where a reader stands in one lane
+struct cursor_struct {
+    int seek;
+    int my_resets;
+    int records; // records of a framed lane read since its last reset
 };
 
+// A consumer group counts as a single subscriber of the minor: all of its
+// members advance the same cursors, so every byte goes to exactly one member.
+// A durable subscription is a group that outlives its last member for
+// durable_retention seconds, so a reopened subscriber resumes where it left.
+struct group_struct {
+    char name[GROUP_NAME_LEN];
+    int members;
+    int durable;
+    unsigned long detached_at; // jiffies when the last member of a durable group left
+    struct cursor_struct cursor[MAX_LANES];
+    unsigned int lvc_seen[MAX_KEYS];
+};
 
+// The state of an open file. What its own reads write and what publishers
+// look at to wake it are on cache lines of their own, so a publisher on
+// another CPU does not pull the reader's cursors away from it.
 struct pdp_strct {
     int minor_id;
     unsigned long type;
-    int seek;
-    int my_resets;
+    struct group_struct *group; // set once a TYPE_GROUP file joined a group
+    int priority; // lane a publisher writes to
+    int read_framed; // hand pubsub_frame headers to the reader
+    __u32 key; // key a publisher's values are stored under in a conflating minor
+    unsigned int zc_done; // PUBLISH_ZC records of this file released so far
+    int blocking; // reads wait for data instead of returning EAGAIN
+    struct merge_struct *merge; // set for TYPE_MERGED
+    struct pdp_strct *parent; // the merged file this subscriber reads for
+    int spin_max; // SET_SPIN, in us
+    // written by the file's reads
+    struct cursor_struct cursor[MAX_LANES] ____cacheline_aligned;
+    unsigned int lvc_seen[MAX_KEYS]; // last slot version read from a conflating minor
+    int spin_budget; // us the next blocking read spins, from avg_gap
+    unsigned int avg_gap; // us between reads that returned data, averaged
+    u64 last_data; // us timestamp of the last of them
+    unsigned int spins; // blocking reads served by spinning
+    unsigned int sleeps; // blocking reads that slept anyway
+    // looked at by the publishers that wake the file
+    wait_queue_head_t wait ____cacheline_aligned; // the file's blocked reads and polls
+    struct list_head link; // in the minor's files
+    int lowat_bytes; // a waiting reader is woken once this much is unread, 0 for any data
+    int lowat_records; // the same in records, for framed minors
+    unsigned long max_delay; // jiffies a reader below its watermark waits at most, 0 for no limit
+    int delay_armed; // deadline is running
+    unsigned long deadline;
 };
 
-struct buffer_struct {
-    int sub_counter;
-    int finished_sub;
+// A CPU's staging area of a high fan-in minor: records its publishers
+// appended and the next drain has not moved into the lanes yet.
+struct stage_struct {
+    struct semaphore sem; // only contended by publishers running on the same CPU
+    char *data;
+    int head; // first record the drain has not taken
+    int len;
+} ____cacheline_aligned;
+
+// a staged record: its stamp orders records across CPUs, a stage's own
+// records are in staging order already
+struct staged_hdr {
+    u64 stamp;
+    int lane;
+    struct pubsub_frame frame; // len, time and key; seq is given by the drain
+};
+
+// A TYPE_MERGED file reads through a subscriber of its own on every minor.
+struct merge_struct {
+    int order; // PUBSUB_MERGE_FAIR or PUBSUB_MERGE_TIME
+    int nr_minors;
+    int next; // subscriber the fair order resumes with
+    struct pdp_strct *subs[MAX_TARGETS];
+};
+
+// A topic buffer: one kmalloc'd area for small topics, or an array of page
+// chunks of PAGE_SIZE << order bytes each for large ones. It is only ever
+// accessed through buff_copy.
+struct buff_struct {
+    char *data;
+    struct page **chunks;
+    int nr_chunks;
+    int order;
+    int node; // NUMA node it was allocated on, -1 if it could not be placed
+};
+
+// A record published with PUBLISH_ZC: the publisher's own pages, pinned until
+// every subscriber read past it, which is when its lane resets. The lane holds
+// the record's frame header followed by a pointer to it instead of a payload.
+struct zc_record {
+    struct page **pages;
+    int nr_pages;
+    int offset; // of the payload in pages[0]
+    int len;
+    struct pdp_strct *publisher; // NULL once the publisher closed
+    struct zc_record *next;
+};
+
+// Each priority lane is a buffer of its own, reset independently once every
+// subscriber has read it.
+// Publishers and subscribers of a lane write to separate cache lines: every
+// publish moves buff_len's line, every read that finishes the lane moves
+// finished_sub's, and the buffer's description is only read by both.
+struct lane_struct {
+    // written by publishers
     int buff_len;
-    char *buff;
+    int records; // records written since the last reset
+    unsigned long written_at; // jiffies of the last write, the age of a raw lane
+    struct zc_record *zc_records; // pinned records in the lane, newest first
+    // written by subscribers, global_reset by whoever hands the lane back
+    int finished_sub ____cacheline_aligned;
     int global_reset;
+    // fixed while the lane is in use
+    struct buff_struct buff ____cacheline_aligned;
+};
+
+// One value of a conflating minor. Slot i lives at i * slot size in lane 0's
+// buffer, stored like a framed record.
+struct lvc_slot {
+    __u32 key;
+    unsigned int version; // bumped by every write to the slot, 0 while empty
+};
+
+struct journal_struct;
+
+// The control block of a minor, in sections by who writes them: settings the
+// ioctls change and every call reads, publisher state, subscriber state,
+// the semaphore both sides take, and the wakeup bookkeeping. Each section
+// starts a cache line so the sides do not invalidate each other's lines.
+struct buffer_struct {
+    // settings
+    int minor;
+    int nr_lanes;
+    int buff_size; // capacity of each lane buffer
+    int framed; // records are stored as a pubsub_frame followed by the payload
+    int nr_keys; // > 0 turns the minor into a last-value cache with that many slots
+    struct journal_struct *journal; // while the minor is persistent
+    int node; // NUMA node of the buffers, -1 until a publisher or SET_NODE places them
+    int node_pinned; // set by SET_NODE: publishers do not move the buffers
+    int retain_bytes; // SET_RETENTION limits, 0 when off
+    int retain_records;
+    int retain_ms;
+    int reclaim_off; // set under sem while the minor is reset or unloaded: nothing arms retention
+    struct stage_struct *stages; // nr_stages() of them once SET_FANIN was used, until reset
+    int stage_size; // bytes of each staging area
+    int fanin; // publishers write to the staging areas
+    int stage_stalled; // the last drain stopped on a full lane, until a lane reset
+    // written by publishers
+    unsigned int seq ____cacheline_aligned; // sequence number of the next framed record
+    unsigned int lvc_version;
+    struct lvc_slot slots[MAX_KEYS];
+    int staged; // a stage holds records; set under the stage's semaphore by the publisher that found it empty
+    // written by subscribers
+    int sub_counter ____cacheline_aligned;
+    unsigned long reclaimed; // bytes dropped by retention
+    struct group_struct groups[MAX_GROUPS];
+    struct semaphore sem ____cacheline_aligned; // serializes cursors and buff_len between files of the minor
+    struct semaphore journal_sem; // held while journal batches are written, taken before sem
+    // opens, closes and wakeups
+    spinlock_t wake_lock ____cacheline_aligned; // files and the reader deadlines, shared with wake_timer
+    struct list_head files; // every open file of the minor
     int reference_count;
+    wait_queue_head_t wq; // publishers polling for room, woken on lane resets
+    struct timer_list wake_timer; // wakes readers whose max_delay ran out
+    struct timer_list retain_timer; // queues reclaim_work when the oldest data expires
+#if PUBSUB_MODERN
+    struct work_struct reclaim_work;
+    struct work_struct drain_work; // moves what publishers staged into the lanes
+    struct work_struct journal_work; // writes the journal batches of a persistent minor
+#else
+    struct tq_struct reclaim_work;
+    struct tq_struct drain_work;
+    struct tq_struct journal_work;
+#endif
+    struct lane_struct lanes[MAX_LANES];
 };
 
-struct buffer_struct *buffer_array[MINOR_NUM];
+// inline rather than allocated one by one: no pointer to chase on every
+// call, and each minor starts on a cache line of its own
+static struct buffer_struct buffer_array[MINOR_NUM];
 
-int init_module(void)
+static void reset_minor(struct buffer_struct *b);
+static void stop_reclaim(struct buffer_struct *b);
+static void zc_forget_publisher(struct buffer_struct *b, struct pdp_strct *pdp_p);
+#if PUBSUB_MODERN
+static void wake_timer_fn(struct timer_list *t);
+static void retain_timer_fn(struct timer_list *t);
+static void reclaim_work_fn(struct work_struct *work);
+static void drain_work_fn(struct work_struct *work);
+static void journal_work_fn(struct work_struct *work);
+#else
+static void wake_timer_fn(unsigned long data);
+static void retain_timer_fn(unsigned long data);
+static void reclaim_work_fn(void *data);
+static void drain_work_fn(void *data);
+static void journal_work_fn(void *data);
+#endif
+static void drain_stages(struct buffer_struct *b);
+static int lock_empty_minor(struct buffer_struct *b);
+static void unlock_stages(struct buffer_struct *b);
+static void free_stages(struct buffer_struct *b);
+static void buff_move(struct buff_struct *bs, int dst, int src, int len);
+// the segment types of a journal
+#define JSEG_DATA 1  // len bytes appended to the lane
+#define JSEG_RESET 2 // the lane was emptied
+#define JSEG_TRIM 3  // retention cut len bytes off the front of the lane
+#define JSEG_CONFIG 4 // the settings changed
+#define JSEG_END 5   // the snapshot that starts the file is complete
+
+static void journal_log(struct buffer_struct *b, int type, int lane, int len);
+static void journal_free(struct journal_struct *j);
+static void journal_data(struct buffer_struct *b, int lane, int off, int len);
+static void journal_write(struct buffer_struct *b);
+static void journal_restore(struct buffer_struct *b, int minor);
+
+
+// bytes a buffer of the given capacity really pins
+static long buff_footprint(int size)
 {
-    // This function is called when inserting the module using insmod
+    return size <= KMALLOC_MAX_BUFF ? size : PAGE_ALIGN(size);
+}
 
-    my_major = register_chrdev(my_major, MY_DEVICE, &my_fops);
+static int buff_exists(struct buff_struct *bs)
+{
+    return bs->data != NULL || bs->chunks != NULL;
+}
 
-    if (my_major < 0)
-    {
-	printk(KERN_WARNING "can't get dynamic major\n");
-	return my_major;
+static void free_chunks(struct buff_struct *bs)
+{
+    int i;
+    for (i = 0; i < bs->nr_chunks; i++) {
+        if (bs->chunks[i] != NULL) {
+            __free_pages(bs->chunks[i], bs->order);
+        }
     }
+    kfree(bs->chunks);
+    bs->chunks = NULL;
+    bs->nr_chunks = 0;
+}
 
+static int alloc_chunks(struct buff_struct *bs, int nr_chunks, int order, int node)
+{
     int i;
-    // we initialize the buffer array pointers:
-    for (  i = 0; i < MINOR_NUM ; i++) {
-        buffer_array[i] = kmalloc(sizeof(struct buffer_struct), GFP_KERNEL);
-        if ( buffer_array[i] == NULL) { return -ENOMEM;}
-        buffer_array[i]->sub_counter = 0;
-        buffer_array[i]->finished_sub = 0;
-        buffer_array[i]->buff_len = 0;
-        buffer_array[i]->buff = NULL;
-        buffer_array[i]->global_reset = 0;
-        buffer_array[i]->reference_count = 0;
+
+    bs->chunks = kmalloc(nr_chunks * sizeof(struct page *), GFP_KERNEL);
+    if (bs->chunks == NULL) {
+        return -ENOMEM;
+    }
+    memset(bs->chunks, 0, nr_chunks * sizeof(struct page *));
+    bs->nr_chunks = nr_chunks;
+    bs->order = order;
+    for (i = 0; i < nr_chunks; i++) {
+        bs->chunks[i] = alloc_pages_node(node, GFP_KERNEL, order);
+        if (bs->chunks[i] == NULL) {
+            free_chunks(bs);
+            return -ENOMEM;
+        }
     }
+    return 0;
+}
 
+static int charge_budget(long bytes)
+{
+    spin_lock(&budget_lock);
+    if (mem_budget > 0 && mem_used + bytes > mem_budget) {
+        spin_unlock(&budget_lock);
+        return -ENOMEM;
+    }
+    mem_used += bytes;
+    spin_unlock(&budget_lock);
     return 0;
 }
 
+static void uncharge_budget(long bytes)
+{
+    spin_lock(&budget_lock);
+    mem_used -= bytes;
+    spin_unlock(&budget_lock);
+}
 
-void cleanup_module(void)
+static int buff_placeable(int size)
 {
-    // This function is called when removing the module using rmmod
+    return PUBSUB_MODERN || size > KMALLOC_MAX_BUFF;
+}
 
-    unregister_chrdev(my_major, MY_DEVICE);
-    int i;
-    for ( i = 0 ; i < MINOR_NUM ; i++) {
-        kfree(buffer_array[i]);
+static void count_node(int node, int n)
+{
+    if (node >= 0 && node < MAX_NODES) {
+        spin_lock(&budget_lock);
+        node_buffers[node] += n;
+        spin_unlock(&budget_lock);
     }
-    return;
 }
 
-
-int my_open(struct inode *inode, struct file *filp)
+// Every topic buffer is charged against mem_budget before it is allocated.
+// Page backed buffers use the largest chunk order that divides them evenly,
+// stepping down to single pages when memory is too fragmented for it. The
+// memory comes from the given NUMA node.
+static int alloc_buff(struct buff_struct *bs, int size, int node)
 {
-    //init pdp pointer and put in filp private_data:
-    struct pdp_strct *p = kmalloc ( sizeof (struct pdp_strct), GFP_KERNEL );
-    if (p == NULL) { return -ENOMEM;}
+    long footprint = buff_footprint(size);
+    int nr_pages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+    int order;
 
-    p->minor_id = MINOR(inode->i_rdev);
-    p->type = TYPE_NONE;
-    p->seek = 0 ; 
-    p->my_resets = buffer_array[p->minor_id]->global_reset;
-    filp->private_data = p; // might be &p
+    if (charge_budget(footprint)) {
+        return -ENOMEM;
+    }
+
+    memset(bs, 0, sizeof(*bs));
+    bs->node = buff_placeable(size) ? node : -1;
+    if (size <= KMALLOC_MAX_BUFF) {
+        bs->data = buff_kmalloc(sizeof(char)*size, node);
+        if (bs->data != NULL) {
+            count_node(bs->node, 1);
+            return 0;
+        }
+    } else {
+        for (order = MAX_CHUNK_ORDER; order >= 0; order--) {
+            if (nr_pages % (1 << order) != 0) {
+                continue;
+            }
+            if (alloc_chunks(bs, nr_pages >> order, order, node) == 0) {
+                count_node(bs->node, 1);
+                return 0;
+            }
+        }
+    }
 
-    buffer_array[p->minor_id]->reference_count++;
+    uncharge_budget(footprint);
+    return -ENOMEM;
+}
 
-    // check if buffer is initiated, if not then initiate
-    if (buffer_array[p->minor_id]->buff == NULL) {
-        char *buff_p = kmalloc ( sizeof(char)*BUFFER_SIZE, GFP_KERNEL );
-        if (buff_p == NULL) { return -ENOMEM;}
-        buffer_array[p->minor_id]->buff = buff_p;
+static void free_buff(struct buff_struct *bs, int size)
+{
+    if (!buff_exists(bs)) {
+        return;
     }
-    
-    return 0;
+    if (bs->data != NULL) {
+        kfree(bs->data);
+        bs->data = NULL;
+    } else {
+        free_chunks(bs);
+    }
+    count_node(bs->node, -1);
+    uncharge_budget(buff_footprint(size));
 }
 
+#define BUFF_TO_USER 0
+#define BUFF_FROM_USER 1
+#define BUFF_TO_KERNEL 2
+#define BUFF_FROM_KERNEL 3
 
-// Fady: this is called each time we close a fd (is that true?)
-int my_release(struct inode *inode, struct file *filp) // release memory initiated in open
+// Address of offset off of the buffer. *n is trimmed to the bytes that are
+// physically contiguous from there.
+static char *buff_area(struct buff_struct *bs, int off, int *n)
 {
-    struct pdp_strct * pdp_p = (struct pdp_strct *) (filp->private_data); 
-    int minor = pdp_p->minor_id;
-    
-    if (pdp_p->type == TYPE_SUB) {
-        buffer_array[minor]->sub_counter --;
+    int chunk_size, in_chunk;
+
+    if (bs->data != NULL) {
+        return bs->data + off;
+    }
+    chunk_size = PAGE_SIZE << bs->order;
+    in_chunk = off % chunk_size;
+    if (*n > chunk_size - in_chunk) {
+        *n = chunk_size - in_chunk;
     }
+    return (char *) page_address(bs->chunks[off / chunk_size]) + in_chunk;
+}
 
-    kfree(pdp_p);
-    
-    buffer_array[minor]->reference_count -=1;
-
-    printk(KERN_INFO "Reference_count is %d.\n", buffer_array[minor]->reference_count);
-    if( buffer_array[minor]->reference_count == 0 ) {
-        printk(KERN_INFO "Reference_count is ZERO.\n");
-        kfree(buffer_array[minor]->buff);
-        buffer_array[minor]->sub_counter = 0;
-        buffer_array[minor]->finished_sub = 0;
-        buffer_array[minor]->buff_len = 0;
-        buffer_array[minor]->buff = NULL;
-        buffer_array[minor]->global_reset = 0;
-        buffer_array[minor]->reference_count = 0;
+// Copy len bytes at offset off of the buffer to or from ptr (a user pointer
+// for the *_USER directions), one physically contiguous piece at a time.
+static int buff_copy(struct buff_struct *bs, int off, char *ptr, int len, int dir)
+{
+    while (len > 0) {
+        int n = len;
+        char *area = buff_area(bs, off, &n);
+
+        switch (dir) {
+        case BUFF_TO_USER:
+            if (copy_to_user(ptr, area, n)) {
+                return -EFAULT;
+            }
+            break;
+        case BUFF_FROM_USER:
+            if (copy_from_user(area, ptr, n)) {
+                return -EFAULT;
+            }
+            break;
+        case BUFF_TO_KERNEL:
+            memcpy(ptr, area, n);
+            break;
+        default:
+            memcpy(area, ptr, n);
+            break;
+        }
+        off += n;
+        ptr += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Copy outside the topic buffers in a BUFF_* direction: to is the user
+// pointer for BUFF_TO_USER, from for BUFF_FROM_USER.
+static int copy_dir(char *to, const char *from, int len, int dir)
+{
+    switch (dir) {
+    case BUFF_TO_USER:
+        return copy_to_user(to, from, len) ? -EFAULT : 0;
+    case BUFF_FROM_USER:
+        return copy_from_user(to, from, len) ? -EFAULT : 0;
+    default:
+        memcpy(to, from, len);
         return 0;
     }
+}
+
+// where new buffers of a minor go: its node once placed, the caller's before
+static int minor_node(struct buffer_struct *b)
+{
+    return b->node >= 0 ? b->node : numa_node_id();
+}
+
+// Move every buffer of a minor to the node, data included: lanes hold only
+// offsets and record pointers, so cursors stay valid. A last-value cache
+// keeps its values in the slots of lane 0, past buff_len. Called with the
+// semaphore held. The minor stays where it was when the node is out of memory.
+static int place_minor(struct buffer_struct *b, int node)
+{
+    int i;
 
+    for (i = 0; i < MAX_LANES; i++) {
+        struct lane_struct *l = &b->lanes[i];
+        struct buff_struct moved;
+        int used = l->buff_len;
+        int off = 0;
 
+        if (!buff_exists(&l->buff) || l->buff.node == node || !buff_placeable(b->buff_size)) {
+            continue;
+        }
+        if (i == 0 && b->nr_keys > 0) {
+            used = b->nr_keys * (b->buff_size / b->nr_keys);
+        }
+        if (alloc_buff(&moved, b->buff_size, node)) {
+            return -ENOMEM;
+        }
+        while (off < used) {
+            int n = used - off;
+            char *area = buff_area(&l->buff, off, &n);
 
+            buff_copy(&moved, off, area, n, BUFF_FROM_KERNEL);
+            off += n;
+        }
+        free_buff(&l->buff, b->buff_size);
+        l->buff = moved;
+    }
+    b->node = node;
     return 0;
 }
 
-ssize_t my_read(struct file *filp, char *buf, size_t count, loff_t *f_pos)
+// SET_NODE: pin a minor to a node, or with -1 let its next publisher place it
+static int set_node(struct buffer_struct *b, int node)
 {
-    //find minor
-    struct pdp_strct *pdp_p = (struct pdp_strct *)filp->private_data; 
-    int minor = pdp_p->minor_id;
+    int ret = 0;
 
-    //check type
-    if (pdp_p->type != TYPE_SUB) {
-        return -EPERM;
+    if (node != -1 && (node >= MAX_NODES || !node_valid(node))) {
+        return -EINVAL;
     }
-    
-    //check if there is something to read
-    if (buffer_array[minor]->buff_len == 0) {
-        return -EAGAIN;
+    down(&b->sem);
+    if (node == -1) {
+        b->node = -1;
+        b->node_pinned = 0;
+    } else {
+        ret = place_minor(b, node);
+        if (ret == 0) {
+            b->node_pinned = 1;
+        }
     }
+    up(&b->sem);
+    return ret;
+}
 
-    //check if the buffer of the file exists
-    if (buffer_array[minor]->buff == NULL) {
-        return -EFAULT;
+// Pin the pages under a publisher's buffer. They count against mem_budget
+// like a topic buffer for as long as they stay pinned.
+static int zc_pin(const char *ubuf, int len, struct zc_record **out)
+{
+    unsigned long start = (unsigned long) ubuf;
+    struct zc_record *rec;
+    int nr_pages, pinned;
+
+    if (len < 1 || len > MAX_ZC_PAGES * PAGE_SIZE) {
+        return -EINVAL;
+    }
+    nr_pages = (PAGE_ALIGN(start + len) - (start & PAGE_MASK)) >> PAGE_SHIFT;
+    if (charge_budget((long) nr_pages * PAGE_SIZE)) {
+        return -ENOMEM;
+    }
+    rec = kmalloc(sizeof(struct zc_record), GFP_KERNEL);
+    if (rec == NULL) {
+        goto no_rec;
+    }
+    rec->pages = kmalloc(nr_pages * sizeof(struct page *), GFP_KERNEL);
+    if (rec->pages == NULL) {
+        goto no_pages;
     }
 
-    //check if we have to reset
-    if (buffer_array[minor]->global_reset != pdp_p->my_resets) {
-        pdp_p->seek = 0;
-        pdp_p->my_resets = buffer_array[minor]->global_reset;
+#if PUBSUB_MODERN
+    // held until every subscriber read the record, which has no bound
+    pinned = pin_user_pages_fast(start & PAGE_MASK, nr_pages, FOLL_LONGTERM, rec->pages);
+#else
+    down_read(&current->mm->mmap_sem);
+    pinned = get_user_pages(current, current->mm, start & PAGE_MASK, nr_pages, 0, 0, rec->pages, NULL);
+    up_read(&current->mm->mmap_sem);
+#endif
+    if (pinned != nr_pages) {
+        while (pinned > 0) {
+            zc_unpin_page(rec->pages[--pinned]);
+        }
+        kfree(rec->pages);
+        kfree(rec);
+        uncharge_budget((long) nr_pages * PAGE_SIZE);
+        return -EFAULT;
     }
 
-    int *seek = &pdp_p->seek;
+    rec->nr_pages = nr_pages;
+    rec->offset = start & ~PAGE_MASK;
+    rec->len = len;
+    rec->publisher = NULL;
+    rec->next = NULL;
+    *out = rec;
+    return 0;
 
-    // find how much to read
-    int read_count = buffer_array[minor]->buff_len - *seek;
-    printk(KERN_INFO "read_count = %d , bl = %d , seek = %d\n",read_count,buffer_array[minor]->buff_len,*seek);
-    if (read_count <= 0) {
-        return -EAGAIN;
-    }
-    if (count < read_count) {
-        read_count = count;
-    }
+no_pages:
+    kfree(rec);
+no_rec:
+    uncharge_budget((long) nr_pages * PAGE_SIZE);
+    return -ENOMEM;
+}
 
-    // copy to the reader buffer
-    if (copy_to_user ( buf, buffer_array[minor]->buff, read_count)) {
-        return -EBADF;
-    }    
+// unpin a record and tell its publisher the buffer is its own again
+static void zc_release(struct zc_record *rec)
+{
+    int i;
 
-    // update seek according to the amount read.
-    *seek += read_count;
-    if ( *seek == buffer_array[minor]->buff_len) {
-        buffer_array[minor]->finished_sub += 1;
+    for (i = 0; i < rec->nr_pages; i++) {
+        zc_unpin_page(rec->pages[i]);
     }
-    // check if all subs are done reading
-    if( buffer_array[minor]->finished_sub ==  buffer_array[minor]->sub_counter) {
-        buffer_array[minor]->global_reset += 1;
-        buffer_array[minor]->buff_len = 0;
-        buffer_array[minor]->finished_sub = 0;
+    uncharge_budget((long) rec->nr_pages * PAGE_SIZE);
+    if (rec->publisher != NULL) {
+        rec->publisher->zc_done ++;
     }
+    kfree(rec->pages);
+    kfree(rec);
+}
 
-    return read_count; 
+static void zc_release_lane(struct lane_struct *l)
+{
+    while (l->zc_records != NULL) {
+        struct zc_record *rec = l->zc_records;
+        l->zc_records = rec->next;
+        zc_release(rec);
+    }
 }
 
-ssize_t my_write(struct file *filp, const char *buf, size_t count, loff_t *f_pos) {
-    //find minor
-    struct pdp_strct *pdp_p = (struct pdp_strct *)filp->private_data; 
-    int minor = pdp_p->minor_id;
+// copy len bytes of a pinned record's payload to a reader
+static int zc_copy(struct zc_record *rec, char *buf, int len, int dir)
+{
+    int off = rec->offset;
+    int i = 0;
 
-    //check type
-    if (pdp_p->type != TYPE_PUB) {
-        return -EPERM;
-    }
+    while (len > 0) {
+        int n = min(len, (int) PAGE_SIZE - off);
+        char *area = kmap(rec->pages[i]);
+        int failed = copy_dir(buf, area + off, n, dir) != 0;
 
-    //check inside buffer size 
-    if (count > BUFFER_SIZE) {
-        return -EINVAL;
+        kunmap(rec->pages[i]);
+        if (failed) {
+            return -EFAULT;
+        }
+        buf += n;
+        len -= n;
+        off = 0;
+        i++;
     }
+    return 0;
+}
 
-    //check remaining space
-    int remaining_buffer_spcae = BUFFER_SIZE - buffer_array[minor]->buff_len;
-    printk(KERN_INFO "rbs = %d , bs = %d , bl = %d , c = %d\n",remaining_buffer_spcae,BUFFER_SIZE,buffer_array[minor]->buff_len,count);
-    if (count > remaining_buffer_spcae ) {
-        return -EAGAIN;
-    }
+// /proc/pubsub: memory usage and the state of every open minor, one line
+// each, at most PROC_LINE_MAX bytes. /proc/pubsub_trace, on 2.4: the trace
+// ring.
+#define PROC_LINE_MAX 256
 
-    //check if the buffer of the file exists
-    if (buffer_array[minor]->buff == NULL) {
-        return -EFAULT;
+// A /proc file: a header line, then line(page, i) for i below nr; a line
+// function returns 0 for entries it skips.
+struct proc_table {
+    int (*header)(char *page);
+    int (*line)(char *page, int i);
+    int nr;
+};
+
+static int proc_header_line(char *page)
+{
+    int len = sprintf(page, "budget %ld used %ld", mem_budget, mem_used);
+    int i;
+
+    for (i = 0; i < MAX_NODES; i++) {
+        if (node_valid(i)) {
+            len += sprintf(page + len, " node%d %d", i, node_buffers[i]);
+        }
     }
+    return len + sprintf(page + len, "\n");
+}
 
-    //copy from user to our buffer
-    if ( copy_from_user(buffer_array[minor]->buff + buffer_array[minor]->buff_len,buf,count) ) {
-        return -EBADF;
+// 0 for a minor nobody uses
+static int proc_minor_line(char *page, int i)
+{
+    struct buffer_struct *b = &buffer_array[i];
+    unsigned long spins = 0;
+    unsigned long sleeps = 0;
+    struct list_head *pos;
+
+    if (b->reference_count == 0 && !buff_exists(&b->lanes[0].buff)) {
+        return 0;
     }
-    buffer_array[minor]->buff_len += count;
+    // spin counts of the files open now
+    spin_lock_bh(&b->wake_lock);
+    list_for_each(pos, &b->files) {
+        struct pdp_strct *p = list_entry(pos, struct pdp_strct, link);
+        spins += p->spins;
+        sleeps += p->sleeps;
+    }
+    spin_unlock_bh(&b->wake_lock);
+    // buffers that cannot be placed, the small ones on 2.4, show node -1
+    return sprintf(page, "minor %d refs %d subs %d lanes %d capacity %d framed %d keys %d "
+                   "retain %d/%d/%d reclaimed %lu node %d%s fanin %d spins %lu sleeps %lu\n",
+                   i, b->reference_count, b->sub_counter, b->nr_lanes, b->buff_size, b->framed,
+                   b->nr_keys, b->retain_bytes, b->retain_records, b->retain_ms, b->reclaimed,
+                   buff_placeable(b->buff_size) ? b->node : -1, b->node_pinned ? " pinned" : "", b->fanin ? b->stage_size : 0, spins, sleeps);
+}
 
-    return count;
+#if !PUBSUB_MODERN
+static const char *trace_names[NR_TRACE_EVENTS] = {
+    "open", "release", "read", "write", "ioctl", "reset", "eagain"
+};
+
+static int trace_header_line(char *page)
+{
+    return sprintf(page, "mask 0x%x events %lu eagain 1 no data 2 no room 3 busy 4 staging full\n",
+                   trace_mask, trace_next);
 }
 
+// the i-th oldest event of the ring
+static int trace_line(char *page, int i)
+{
+    struct trace_entry t;
+
+    spin_lock_bh(&trace_lock);
+    if (i >= trace_next) {
+        spin_unlock_bh(&trace_lock);
+        return 0;
+    }
+    if (trace_next > TRACE_ENTRIES) {
+        i = (trace_next + i) % TRACE_ENTRIES;
+    }
+    t = trace_ring[i];
+    spin_unlock_bh(&trace_lock);
+    return sprintf(page, "%lu %s minor %d type %d value %d seek %d resets %d arg %lu\n",
+                   t.when, trace_names[t.event], t.minor, t.type, t.value, t.seek, t.resets, t.arg);
+}
 
+static struct proc_table trace_table = { trace_header_line, trace_line, TRACE_ENTRIES };
+#endif
 
-int my_ioctl(struct inode *inode, struct file *filp, unsigned int cmd, unsigned long arg)
+static struct proc_table minors_table = { proc_header_line, proc_minor_line, MINOR_NUM };
+
+#if PUBSUB_MODERN
+static int pubsub_proc_show(struct seq_file *m, void *v)
 {
-    struct pdp_strct *pdp_p = (struct pdp_strct *) filp->private_data;
-    int minor = pdp_p->minor_id;
-    switch(cmd)
-    {
-    case SET_TYPE:
-        if ((arg !=TYPE_PUB) && (arg != TYPE_SUB) ) {
-            return -EINVAL;
+    struct proc_table *t = m->private;
+    char line[PROC_LINE_MAX];
+    int i;
+
+    t->header(line);
+    seq_puts(m, line);
+    for (i = 0; i < t->nr; i++) {
+        if (t->line(line, i)) {
+            seq_puts(m, line);
         }
-        if (pdp_p->type != TYPE_NONE) {
-            return -EPERM;
+    }
+    return 0;
+}
+#else
+static int pubsub_read_proc(char *page, char **start, off_t off, int count, int *eof, void *data)
+{
+    struct proc_table *t = data;
+    int len = 0;
+    off_t begin = 0;
+    int i;
+
+    len += t->header(page + len);
+    for (i = 0; i < t->nr; i++) {
+        len += t->line(page + len, i);
+        if (begin + len < off) {
+            begin += len;
+            len = 0;
         }
-        pdp_p->type = arg;
-        if (pdp_p->type == TYPE_SUB) {
-            buffer_array[minor]->sub_counter ++;
+        if (begin + len > off + count) {
+            goto done;
         }
-        return 0;
-	break;
-    case GET_TYPE:
-        /*if ((pdp_p->type != TYPE_PUB) && (pdp_p != TYPE_SUB)) {
-            return TYPE_NONE;
-        }*/
-        return pdp_p->type;
-	break;
-    default:
-	return -ENOTTY;
     }
+    *eof = 1;
+done:
+    *start = page + (off - begin);
+    len -= (off - begin);
+    if (len > count) {
+        len = count;
+    }
+    if (len < 0) {
+        len = 0;
+    }
+    return len;
+}
+#endif
+
+int init_module(void)
+{
+    // This function is called when inserting the module using insmod
+    int i;
+
+    my_major = register_chrdev(my_major, MY_DEVICE, &my_fops);
+
+    if (my_major < 0)
+    {
+	printk(KERN_WARNING "can't get dynamic major\n");
+	return my_major;
+    }
+
+    // we initialize the minors' control blocks:
+    for (  i = 0; i < MINOR_NUM ; i++) {
+        buffer_array[i].minor = i;
+        buffer_array[i].sub_counter = 0;
+        buffer_array[i].reference_count = 0;
+        buffer_array[i].nr_lanes = 1;
+        buffer_array[i].buff_size = BUFFER_SIZE;
+        buffer_array[i].framed = 0;
+        buffer_array[i].seq = 0;
+        buffer_array[i].nr_keys = 0;
+        buffer_array[i].lvc_version = 0;
+        memset(buffer_array[i].slots, 0, sizeof(buffer_array[i].slots));
+        memset(buffer_array[i].lanes, 0, sizeof(buffer_array[i].lanes));
+        memset(buffer_array[i].groups, 0, sizeof(buffer_array[i].groups));
+        init_MUTEX(&buffer_array[i].sem);
+        init_MUTEX(&buffer_array[i].journal_sem);
+        init_waitqueue_head(&buffer_array[i].wq);
+        INIT_LIST_HEAD(&buffer_array[i].files);
+        spin_lock_init(&buffer_array[i].wake_lock);
+#if PUBSUB_MODERN
+        timer_setup(&buffer_array[i].wake_timer, wake_timer_fn, 0);
+#else
+        init_timer(&buffer_array[i].wake_timer);
+        buffer_array[i].wake_timer.function = wake_timer_fn;
+        buffer_array[i].wake_timer.data = (unsigned long) &buffer_array[i];
+#endif
+        buffer_array[i].retain_bytes = 0;
+        buffer_array[i].retain_records = 0;
+        buffer_array[i].retain_ms = 0;
+        buffer_array[i].reclaimed = 0;
+        buffer_array[i].reclaim_off = 0;
+#if PUBSUB_MODERN
+        timer_setup(&buffer_array[i].retain_timer, retain_timer_fn, 0);
+        INIT_WORK(&buffer_array[i].reclaim_work, reclaim_work_fn);
+        INIT_WORK(&buffer_array[i].drain_work, drain_work_fn);
+        INIT_WORK(&buffer_array[i].journal_work, journal_work_fn);
+#else
+        init_timer(&buffer_array[i].retain_timer);
+        buffer_array[i].retain_timer.function = retain_timer_fn;
+        buffer_array[i].retain_timer.data = (unsigned long) &buffer_array[i];
+        INIT_TQUEUE(&buffer_array[i].reclaim_work, reclaim_work_fn, &buffer_array[i]);
+        INIT_TQUEUE(&buffer_array[i].drain_work, drain_work_fn, &buffer_array[i]);
+        INIT_TQUEUE(&buffer_array[i].journal_work, journal_work_fn, &buffer_array[i]);
+#endif
+        buffer_array[i].journal = NULL;
+        buffer_array[i].node = -1;
+        buffer_array[i].node_pinned = 0;
+        buffer_array[i].stages = NULL;
+        buffer_array[i].stage_size = 0;
+        buffer_array[i].fanin = 0;
+        buffer_array[i].staged = 0;
+        buffer_array[i].stage_stalled = 0;
+        journal_restore(&buffer_array[i], i);
+    }
+
+#if PUBSUB_MODERN
+    proc_create_single_data(MY_DEVICE, 0, NULL, pubsub_proc_show, &minors_table);
+#else
+    create_proc_read_entry(MY_DEVICE, 0, NULL, pubsub_read_proc, &minors_table);
+    create_proc_read_entry(MY_DEVICE "_trace", 0, NULL, pubsub_read_proc, &trace_table);
+#endif
 
     return 0;
 }
+
+
+void cleanup_module(void)
+{
+    // This function is called when removing the module using rmmod
+    int i;
+
+#if !PUBSUB_MODERN
+    remove_proc_entry(MY_DEVICE "_trace", NULL);
+#endif
+    remove_proc_entry(MY_DEVICE, NULL);
+    unregister_chrdev(my_major, MY_DEVICE);
+    for ( i = 0 ; i < MINOR_NUM ; i++) {
+        down(&buffer_array[i].sem);
+        buffer_array[i].reclaim_off = 1;
+        up(&buffer_array[i].sem);
+        stop_reclaim(&buffer_array[i]);
+        // what the batches hold goes to disk before the journal is closed
+        journal_write(&buffer_array[i]);
+#if PUBSUB_MODERN
+        cancel_work_sync(&buffer_array[i].drain_work);
+        cancel_work_sync(&buffer_array[i].journal_work);
+#endif
+    }
+#if !PUBSUB_MODERN
+    flush_scheduled_tasks();
+#endif
+    for ( i = 0 ; i < MINOR_NUM ; i++) {
+        del_timer_sync(&buffer_array[i].wake_timer);
+        // durable subscriptions may keep the buffers of a closed minor
+        reset_minor(&buffer_array[i]);
+    }
+    return;
+}
+
+
+// the cursors a reader advances: its own, or the ones shared by its group
+static struct cursor_struct *reader_cursor(struct pdp_strct *pdp_p)
+{
+    return pdp_p->group ? pdp_p->group->cursor : pdp_p->cursor;
+}
+
+static void init_cursor(struct buffer_struct *b, struct cursor_struct *cursor)
+{
+    int i;
+    for (i = 0; i < MAX_LANES; i++) {
+        cursor[i].seek = 0;
+        cursor[i].my_resets = b->lanes[i].global_reset;
+        cursor[i].records = 0;
+    }
+}
+
+// a reader is counted in the lane's finished_sub once its cursor reached buff_len
+static int reader_finished(struct lane_struct *l, struct cursor_struct *c)
+{
+    return l->buff_len > 0 && c->my_resets == l->global_reset && c->seek == l->buff_len;
+}
+
+// hand a lane back to the publishers, empty
+static void reset_lane(struct buffer_struct *b, struct lane_struct *l)
+{
+    pubsub_trace(TRACE_RESET, b->minor, TYPE_NONE, l->buff_len, l->buff_len, l->global_reset, l - b->lanes);
+    l->global_reset += 1;
+    l->buff_len = 0;
+    l->finished_sub = 0;
+    l->records = 0;
+    zc_release_lane(l);
+    wake_up_interruptible(&b->wq);
+    // staged records held back by a full lane can move now
+    if (b->staged) {
+        b->stage_stalled = 0;
+        schedule_pubsub_work(&b->drain_work);
+    }
+    if (b->journal != NULL) {
+        journal_log(b, JSEG_RESET, l - b->lanes, 0);
+    }
+}
+
+// once every subscriber read the whole lane it is handed back to the publishers
+static void check_all_finished(struct buffer_struct *b, struct lane_struct *l)
+{
+    if (b->sub_counter > 0 && l->finished_sub >= b->sub_counter) {
+        reset_lane(b, l);
+    }
+}
+
+// drop one subscriber (a plain TYPE_SUB or a whole group) from the counters
+static void remove_subscriber(struct buffer_struct *b, struct cursor_struct *cursor)
+{
+    int i;
+    for (i = 0; i < b->nr_lanes; i++) {
+        if (reader_finished(&b->lanes[i], &cursor[i])) {
+            b->lanes[i].finished_sub --;
+        }
+    }
+    b->sub_counter --;
+    for (i = 0; i < b->nr_lanes; i++) {
+        check_all_finished(b, &b->lanes[i]);
+    }
+}
+
+// a group slot is taken while it has members or retains a durable cursor
+static int group_in_use(struct group_struct *g)
+{
+    return g->members > 0 || g->durable;
+}
+
+// Drop the durable subscriptions that were detached for longer than
+// durable_retention, releasing the data they held back.
+static void expire_durable(struct buffer_struct *b)
+{
+    int i;
+    for (i = 0; i < MAX_GROUPS; i++) {
+        struct group_struct *g = &b->groups[i];
+        if (g->durable && g->members == 0 &&
+            time_after(jiffies, g->detached_at + durable_retention * HZ)) {
+            remove_subscriber(b, g->cursor);
+            memset(g, 0, sizeof(*g));
+        }
+    }
+}
+
+static int has_durable(struct buffer_struct *b)
+{
+    int i;
+    for (i = 0; i < MAX_GROUPS; i++) {
+        if (b->groups[i].durable) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// return a minor nobody has open to its initial state
+static void reset_minor(struct buffer_struct *b)
+{
+    int i;
+
+    for (i = 0; i < MAX_LANES; i++) {
+        zc_release_lane(&b->lanes[i]);
+        free_buff(&b->lanes[i].buff, b->buff_size);
+    }
+    memset(b->lanes, 0, sizeof(b->lanes));
+    b->sub_counter = 0;
+    b->nr_lanes = 1;
+    b->buff_size = BUFFER_SIZE;
+    b->framed = 0;
+    b->seq = 0;
+    b->nr_keys = 0;
+    b->lvc_version = 0;
+    memset(b->slots, 0, sizeof(b->slots));
+    b->reference_count = 0;
+    memset(b->groups, 0, sizeof(b->groups));
+    b->retain_bytes = 0;
+    b->retain_records = 0;
+    b->retain_ms = 0;
+    b->node = -1;
+    b->node_pinned = 0;
+    // nobody has the minor open, so nobody is staging
+    free_stages(b);
+    if (b->journal != NULL) {
+        journal_free(b->journal);
+        b->journal = NULL;
+    }
+}
+
+
+// The journal of a persistent minor is an append-only log of page aligned
+// segments: a header page, then for JSEG_DATA the bytes appended to a lane,
+// padded to whole pages, so on load they are read in page runs straight into
+// the lane buffer instead of being replayed record by record. Resets, trims
+// and setting changes are segments of their own; nothing already written is
+// rewritten. Publishers only copy their bytes into a batch under the minor's
+// semaphore; journal_work writes the batch and syncs the file outside of it,
+// so a record reaches the disk within one batch of its publish.
+//
+// A file starts with a snapshot of the minor ending in a JSEG_END. Once the
+// log grows past journal_limit, or when it fell behind (both batches full),
+// journal_work writes a snapshot to the minor's other file under the next
+// generation. Load takes the newest generation whose snapshot is complete.
+#define JOURNAL_MAGIC 0x50534a32 // "PSJ2"
+#define JOURNAL_BATCH (16 * PAGE_SIZE) // bytes of segments collected before journal_work writes them
+#define JOURNAL_SUM_INIT 2166136261u
+
+struct journal_segment {
+    __u32 magic;
+    __u32 gen; // of the file: a segment left over from an older one never matches
+    __u32 type;
+    __u32 lane;
+    __u32 len;
+    __u32 sum; // of a JSEG_DATA payload, to tell a torn write from a record
+    __u32 seq; // the minor's next framed seq after the segment
+    __u32 buff_size; // the settings, in every segment
+    __u32 nr_lanes;
+    __u32 framed;
+};
+
+struct journal_struct {
+    struct file *file;
+    __u32 gen;
+    loff_t end; // where journal_work writes the next batch
+    char *batch[2]; // publishers fill batch[cur], journal_work writes the other
+    int len[2];
+    int cur;
+    int open; // offset in batch[cur] of a JSEG_DATA that can still grow, -1 if none
+    int open_lane;
+    int lost; // a batch was dropped: the next journal_work writes a new generation
+};
+
+static int journal_io(struct file *f, char *data, int len, loff_t pos, int write)
+{
+    int ret;
+#if PUBSUB_MODERN
+    if (write) {
+        ret = kernel_write(f, data, len, &pos);
+    } else {
+        ret = kernel_read(f, data, len, &pos);
+    }
+#else
+    mm_segment_t old_fs = get_fs();
+
+    set_fs(KERNEL_DS);
+    if (write) {
+        ret = f->f_op->write(f, data, len, &pos);
+    } else {
+        ret = f->f_op->read(f, data, len, &pos);
+    }
+    set_fs(old_fs);
+#endif
+    return ret == len ? 0 : -EIO;
+}
+
+static int journal_sync(struct file *f)
+{
+#if PUBSUB_MODERN
+    return vfs_fsync(f, 1);
+#else
+    struct inode *inode = f->f_dentry->d_inode;
+    int ret;
+
+    if (f->f_op == NULL || f->f_op->fsync == NULL) {
+        return -EINVAL;
+    }
+    filemap_fdatasync(inode->i_mapping);
+    down(&inode->i_sem);
+    ret = f->f_op->fsync(f, f->f_dentry, 1);
+    up(&inode->i_sem);
+    filemap_fdatawait(inode->i_mapping);
+    return ret;
+#endif
+}
+
+static struct file *journal_open(int minor, int parity, int flags)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/pubsub%d.%d.seg", persist_dir, minor, parity);
+    return filp_open(path, flags | O_LARGEFILE, 0600);
+}
+
+// FNV-1a, carried across the pieces of a payload
+static __u32 journal_sum(__u32 sum, const char *p, int len)
+{
+    while (len-- > 0) {
+        sum = (sum ^ (unsigned char) *p++) * 16777619;
+    }
+    return sum;
+}
+
+static __u32 journal_lane_sum(struct buff_struct *bs, int off, int len)
+{
+    __u32 sum = JOURNAL_SUM_INIT;
+
+    while (len > 0) {
+        int n = len;
+        char *area = buff_area(bs, off, &n);
+
+        sum = journal_sum(sum, area, n);
+        off += n;
+        len -= n;
+    }
+    return sum;
+}
+
+static void journal_seg_init(struct buffer_struct *b, struct journal_segment *seg, __u32 gen, int type,
+                             int lane, int len)
+{
+    memset(seg, 0, sizeof(*seg));
+    seg->magic = JOURNAL_MAGIC;
+    seg->gen = gen;
+    seg->type = type;
+    seg->lane = lane;
+    seg->len = len;
+    seg->sum = JOURNAL_SUM_INIT;
+    seg->seq = b->seq;
+    seg->buff_size = b->buff_size;
+    seg->nr_lanes = b->nr_lanes;
+    seg->framed = b->framed;
+}
+
+// Move len bytes of a lane from offset off between its buffer and the file
+// at pos, in physically contiguous pieces.
+static int journal_lane_io(struct file *f, loff_t pos, struct buff_struct *bs, int off, int len, int write)
+{
+    while (len > 0) {
+        int n = len;
+        char *area = buff_area(bs, off, &n);
+
+        if (journal_io(f, area, n, pos, write)) {
+            return -EIO;
+        }
+        pos += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Write what the minor holds as the snapshot that starts a journal file of
+// generation gen, and sync it. Returns where the log continues.
+static loff_t journal_snapshot(struct buffer_struct *b, struct file *f, __u32 gen)
+{
+    struct journal_segment seg;
+    loff_t pos = 0;
+    int i;
+
+    for (i = 0; i < b->nr_lanes; i++) {
+        struct lane_struct *l = &b->lanes[i];
+
+        if (l->buff_len == 0) {
+            continue;
+        }
+        journal_seg_init(b, &seg, gen, JSEG_DATA, i, l->buff_len);
+        seg.sum = journal_lane_sum(&l->buff, 0, l->buff_len);
+        if (journal_io(f, (char *) &seg, sizeof(seg), pos, 1) ||
+            journal_lane_io(f, pos + PAGE_SIZE, &l->buff, 0, l->buff_len, 1)) {
+            return -EIO;
+        }
+        pos += PAGE_SIZE + PAGE_ALIGN(l->buff_len);
+    }
+    journal_seg_init(b, &seg, gen, JSEG_END, 0, 0);
+    if (journal_io(f, (char *) &seg, sizeof(seg), pos, 1) || journal_sync(f)) {
+        return -EIO;
+    }
+    return pos + PAGE_SIZE;
+}
+
+static struct journal_struct *journal_alloc(struct file *f, __u32 gen, loff_t end)
+{
+    struct journal_struct *j = kmalloc(sizeof(*j), GFP_KERNEL);
+
+    if (j == NULL) {
+        return NULL;
+    }
+    memset(j, 0, sizeof(*j));
+    j->batch[0] = vmalloc(JOURNAL_BATCH);
+    j->batch[1] = vmalloc(JOURNAL_BATCH);
+    if (j->batch[0] == NULL || j->batch[1] == NULL) {
+        vfree(j->batch[0]);
+        vfree(j->batch[1]);
+        kfree(j);
+        return NULL;
+    }
+    j->file = f;
+    j->gen = gen;
+    j->end = end;
+    j->open = -1;
+    return j;
+}
+
+static void journal_free(struct journal_struct *j)
+{
+    filp_close(j->file, NULL);
+    vfree(j->batch[0]);
+    vfree(j->batch[1]);
+    kfree(j);
+}
+
+// Clear the first header of both files of a minor so journal_restore finds
+// nothing in them.
+static int journal_invalidate(int minor)
+{
+    struct journal_segment seg;
+    int ret = 0;
+    int p;
+
+    memset(&seg, 0, sizeof(seg));
+    for (p = 0; p < 2; p++) {
+        struct file *f = journal_open(minor, p, O_RDWR);
+
+        if (IS_ERR(f)) {
+            continue;
+        }
+        if (journal_io(f, (char *) &seg, sizeof(seg), 0, 1) || journal_sync(f)) {
+            ret = -EIO;
+        }
+        filp_close(f, NULL);
+    }
+    return ret;
+}
+
+// pad the segment that is growing at the end of batch[cur] to whole pages
+static void journal_seg_close(struct journal_struct *j)
+{
+    int len = j->len[j->cur];
+
+    if (j->open >= 0) {
+        memset(j->batch[j->cur] + len, 0, PAGE_ALIGN(len) - len);
+        j->len[j->cur] = PAGE_ALIGN(len);
+        j->open = -1;
+    }
+}
+
+// Start a segment at the end of batch[cur], with room for len bytes of
+// payload for a JSEG_DATA, handing a full batch over to journal_work. NULL
+// when the other batch is still waiting for the disk: the journal fell
+// behind, and instead of the records the next generation's snapshot carries
+// the minor. Called with the semaphore held, on a persistent minor.
+static struct journal_segment *journal_seg_start(struct buffer_struct *b, int type, int lane, int len)
+{
+    struct journal_struct *j = b->journal;
+    int need = PAGE_SIZE + (type == JSEG_DATA ? PAGE_ALIGN(len) : 0);
+    struct journal_segment *seg;
+
+    schedule_pubsub_work(&b->journal_work);
+    if (j->lost) {
+        return NULL;
+    }
+    journal_seg_close(j);
+    if (j->len[j->cur] + need > JOURNAL_BATCH) {
+        if (j->len[!j->cur] > 0 || need > JOURNAL_BATCH) {
+            j->lost = 1;
+            j->len[j->cur] = 0;
+            return NULL;
+        }
+        j->cur = !j->cur;
+    }
+    seg = (struct journal_segment *) (j->batch[j->cur] + j->len[j->cur]);
+    memset(seg, 0, PAGE_SIZE);
+    journal_seg_init(b, seg, j->gen, type, lane, len);
+    j->len[j->cur] += PAGE_SIZE;
+    return seg;
+}
+
+// a segment without payload: JSEG_RESET, JSEG_TRIM or JSEG_CONFIG
+static void journal_log(struct buffer_struct *b, int type, int lane, int len)
+{
+    journal_seg_start(b, type, lane, len);
+}
+
+// Journal len bytes just appended to a lane at off, growing the batch's last
+// segment when it is the same lane's.
+static void journal_data(struct buffer_struct *b, int lane, int off, int len)
+{
+    struct journal_struct *j = b->journal;
+    struct journal_segment *seg;
+    char *dst;
+
+    if (j->open >= 0 && j->open_lane == lane && j->len[j->cur] + len <= JOURNAL_BATCH) {
+        seg = (struct journal_segment *) (j->batch[j->cur] + j->open);
+        schedule_pubsub_work(&b->journal_work);
+    } else {
+        seg = journal_seg_start(b, JSEG_DATA, lane, len);
+        if (seg == NULL) {
+            return;
+        }
+        seg->len = 0;
+        j->open = (char *) seg - j->batch[j->cur];
+        j->open_lane = lane;
+    }
+    dst = j->batch[j->cur] + j->len[j->cur];
+    buff_copy(&b->lanes[lane].buff, off, dst, len, BUFF_TO_KERNEL);
+    seg->sum = journal_sum(seg->sum, dst, len);
+    seg->len += len;
+    seg->seq = b->seq;
+    j->len[j->cur] += len;
+}
+
+// the log is rewritten once it holds four times what a snapshot would
+static loff_t journal_limit(struct buffer_struct *b)
+{
+    return 4 * ((loff_t) b->nr_lanes * (PAGE_SIZE + PAGE_ALIGN(b->buff_size)) + PAGE_SIZE) + 4 * JOURNAL_BATCH;
+}
+
+// Start the next generation from a snapshot of the minor, dropping what the
+// batches hold: the snapshot has it. Called with both semaphores held.
+static int journal_rotate(struct buffer_struct *b)
+{
+    struct journal_struct *j = b->journal;
+    __u32 gen = j->gen + 1;
+    struct file *f = journal_open(b->minor, gen & 1, O_RDWR | O_CREAT | O_TRUNC);
+    loff_t end;
+
+    if (IS_ERR(f)) {
+        printk_ratelimited(KERN_WARNING "pubsub: cannot open the journal of minor %d\n", b->minor);
+        return PTR_ERR(f);
+    }
+    end = journal_snapshot(b, f, gen);
+    if (end < 0) {
+        filp_close(f, NULL);
+        printk_ratelimited(KERN_WARNING "pubsub: journal snapshot of minor %d failed\n", b->minor);
+        return end;
+    }
+    filp_close(j->file, NULL);
+    j->file = f;
+    j->gen = gen;
+    j->end = end;
+    j->len[0] = 0;
+    j->len[1] = 0;
+    j->open = -1;
+    j->lost = 0;
+    return 0;
+}
+
+// Write the batches of a persistent minor, oldest first, syncing the file
+// after each; rotate when due. The semaphore is dropped around the I/O:
+// journal_sem keeps the batch being written and the file in place.
+static void journal_write(struct buffer_struct *b)
+{
+    down(&b->journal_sem);
+    down(&b->sem);
+    for (;;) {
+        struct journal_struct *j = b->journal;
+        loff_t pos;
+        int ret;
+        int w;
+
+        if (j == NULL) {
+            break;
+        }
+        if (j->lost || j->end > journal_limit(b)) {
+            journal_rotate(b);
+            break;
+        }
+        if (j->len[!j->cur] == 0) {
+            if (j->len[j->cur] == 0) {
+                break;
+            }
+            journal_seg_close(j);
+            j->cur = !j->cur;
+        }
+        w = !j->cur;
+        pos = j->end;
+        j->end += j->len[w];
+        up(&b->sem);
+        ret = journal_io(j->file, j->batch[w], j->len[w], pos, 1);
+        if (ret == 0) {
+            ret = journal_sync(j->file);
+        }
+        down(&b->sem);
+        if (ret) {
+            printk_ratelimited(KERN_WARNING "pubsub: journal write of minor %d failed\n", b->minor);
+            j->lost = 1;
+        }
+        j->len[w] = 0;
+    }
+    up(&b->sem);
+    up(&b->journal_sem);
+}
+
+#if PUBSUB_MODERN
+static void journal_work_fn(struct work_struct *work)
+{
+    journal_write(container_of(work, struct buffer_struct, journal_work));
+}
+#else
+static void journal_work_fn(void *data)
+{
+    journal_write((struct buffer_struct *) data);
+}
+#endif
+
+// Start or stop journaling a minor. Starting writes out what it holds now.
+static int set_persist(struct buffer_struct *b, int minor, int persist)
+{
+    struct journal_struct *j;
+    struct file *f;
+    loff_t end;
+    int i;
+
+    if (!persist) {
+        int ret = 0;
+
+        down(&b->journal_sem);
+        down(&b->sem);
+        if (b->journal != NULL) {
+            // what the minor held must not come back on the next load
+            ret = journal_invalidate(minor);
+            journal_free(b->journal);
+            b->journal = NULL;
+        }
+        up(&b->sem);
+        up(&b->journal_sem);
+        return ret;
+    }
+    down(&b->sem);
+    if (b->nr_keys > 0) {
+        up(&b->sem);
+        return -EINVAL;
+    }
+    if (b->journal != NULL) {
+        up(&b->sem);
+        return 0;
+    }
+    // pinned records live outside the lanes and cannot be journaled
+    for (i = 0; i < b->nr_lanes; i++) {
+        if (b->lanes[i].zc_records != NULL) {
+            up(&b->sem);
+            return -EBUSY;
+        }
+    }
+    // a file left from an earlier period must not outrank generation 1
+    if (journal_invalidate(minor)) {
+        up(&b->sem);
+        return -EIO;
+    }
+    f = journal_open(minor, 1, O_RDWR | O_CREAT | O_TRUNC);
+    if (IS_ERR(f)) {
+        up(&b->sem);
+        return PTR_ERR(f);
+    }
+    end = journal_snapshot(b, f, 1);
+    j = end < 0 ? NULL : journal_alloc(f, 1, end);
+    if (j == NULL) {
+        filp_close(f, NULL);
+        up(&b->sem);
+        return end < 0 ? (int) end : -ENOMEM;
+    }
+    b->journal = j;
+    up(&b->sem);
+    return 0;
+}
+
+// The records of a restored framed lane, -EINVAL unless its frames tile it
+// exactly: a len read from disk is never trusted to stay inside the lane.
+// Their stamps are from before the load, so their age starts over.
+static int count_frames(struct lane_struct *l)
+{
+    struct pubsub_frame frame;
+    int off = 0;
+    int n = 0;
+
+    while (off < l->buff_len) {
+        if (l->buff_len - off < sizeof(frame)) {
+            return -EINVAL;
+        }
+        buff_copy(&l->buff, off, (char *) &frame, sizeof(frame), BUFF_TO_KERNEL);
+        frame.stamp = jiffies;
+        buff_copy(&l->buff, off, (char *) &frame, sizeof(frame), BUFF_FROM_KERNEL);
+        off += sizeof(frame);
+        if (frame.len > l->buff_len - off) {
+            return -EINVAL;
+        }
+        off += frame.len;
+        n ++;
+    }
+    return n;
+}
+
+// Take the settings of a segment. They only change on an empty minor.
+static int journal_settings(struct buffer_struct *b, struct journal_segment *seg)
+{
+    int i;
+
+    if (seg->nr_lanes < 1 || seg->nr_lanes > MAX_LANES || (int) seg->buff_size < 1 || seg->framed > 1) {
+        return -EINVAL;
+    }
+    if (buff_exists(&b->lanes[0].buff) && seg->buff_size == b->buff_size && seg->nr_lanes == b->nr_lanes &&
+        seg->framed == b->framed) {
+        return 0;
+    }
+    for (i = 0; i < MAX_LANES; i++) {
+        if (b->lanes[i].buff_len != 0) {
+            return -EINVAL;
+        }
+        free_buff(&b->lanes[i].buff, b->buff_size);
+    }
+    b->buff_size = seg->buff_size;
+    b->nr_lanes = seg->nr_lanes;
+    b->framed = seg->framed;
+    for (i = 0; i < b->nr_lanes; i++) {
+        if (alloc_buff(&b->lanes[i].buff, b->buff_size, minor_node(b))) {
+            return -ENOMEM;
+        }
+    }
+    return 0;
+}
+
+// Apply the segments of a journal file to the minor. Returns where its log
+// ends: at the end of the file, or at the first segment that was not written
+// whole. -ENODATA when the snapshot the file starts with is incomplete,
+// another negative errno when the file cannot be what the minor held.
+static loff_t journal_replay(struct buffer_struct *b, struct file *f, __u32 gen)
+{
+    struct journal_segment seg;
+    int complete = 0;
+    loff_t pos = 0;
+    int ret;
+
+    while (journal_io(f, (char *) &seg, sizeof(seg), pos, 0) == 0 && seg.magic == JOURNAL_MAGIC && seg.gen == gen) {
+        struct lane_struct *l;
+
+        ret = journal_settings(b, &seg);
+        if (ret) {
+            return ret;
+        }
+        if (seg.type < JSEG_DATA || seg.type > JSEG_END || seg.lane >= b->nr_lanes) {
+            return -EINVAL;
+        }
+        l = &b->lanes[seg.lane];
+        if (seg.type == JSEG_DATA) {
+            if (seg.len > b->buff_size - l->buff_len) {
+                return -EINVAL;
+            }
+            // a torn payload ends the log
+            if (journal_lane_io(f, pos + PAGE_SIZE, &l->buff, l->buff_len, seg.len, 0) ||
+                journal_lane_sum(&l->buff, l->buff_len, seg.len) != seg.sum) {
+                break;
+            }
+            l->buff_len += seg.len;
+        } else if (seg.type == JSEG_RESET) {
+            l->buff_len = 0;
+        } else if (seg.type == JSEG_TRIM) {
+            if (seg.len > l->buff_len) {
+                return -EINVAL;
+            }
+            buff_move(&l->buff, 0, seg.len, l->buff_len - seg.len);
+            l->buff_len -= seg.len;
+        } else if (seg.type == JSEG_END) {
+            complete = 1;
+        }
+        b->seq = seg.seq;
+        pos += PAGE_SIZE + (seg.type == JSEG_DATA ? PAGE_ALIGN(seg.len) : 0);
+    }
+    return complete ? pos : -ENODATA;
+}
+
+// On load: rebuild a minor that was persistent from the newest generation of
+// its journal, if any.
+static void journal_restore(struct buffer_struct *b, int minor)
+{
+    struct journal_segment first[2];
+    struct file *f[2];
+    struct journal_struct *j;
+    loff_t end = -ENOENT;
+    int p, i;
+
+    for (p = 0; p < 2; p++) {
+        f[p] = journal_open(minor, p, O_RDWR);
+        if (IS_ERR(f[p])) {
+            f[p] = NULL;
+        } else if (journal_io(f[p], (char *) &first[p], sizeof(first[p]), 0, 0) ||
+                   first[p].magic != JOURNAL_MAGIC) {
+            filp_close(f[p], NULL);
+            f[p] = NULL;
+        }
+    }
+    if (f[0] == NULL && f[1] == NULL) {
+        return;
+    }
+    p = f[1] != NULL && (f[0] == NULL || (int) (first[1].gen - first[0].gen) > 0);
+    if (f[p] != NULL) {
+        end = journal_replay(b, f[p], first[p].gen);
+        // a rotation that did not finish: the older generation still holds
+        if (end == -ENODATA && f[!p] != NULL) {
+            reset_minor(b);
+            p = !p;
+            end = journal_replay(b, f[p], first[p].gen);
+        }
+    }
+    for (i = 0; end >= 0 && b->framed && i < b->nr_lanes; i++) {
+        b->lanes[i].records = count_frames(&b->lanes[i]);
+        if (b->lanes[i].records < 0) {
+            end = -EINVAL;
+        }
+    }
+    j = end >= 0 ? journal_alloc(f[p], first[p].gen, end) : NULL;
+    if (f[!p] != NULL) {
+        filp_close(f[!p], NULL);
+    }
+    if (j == NULL) {
+        if (f[p] != NULL) {
+            printk(KERN_WARNING "pubsub: cannot restore minor %d from its journal\n", minor);
+            filp_close(f[p], NULL);
+        }
+        reset_minor(b);
+        return;
+    }
+    b->journal = j;
+    // whatever follows the log was torn: the next writes start a new file
+    if (end < journal_file_size(f[p])) {
+        j->lost = 1;
+        schedule_pubsub_work(&b->journal_work);
+    }
+    printk(KERN_INFO "pubsub: restored minor %d from its journal\n", minor);
+}
+
+// the lanes other than lane 0 are only allocated once a minor asks for them
+static int set_lanes(struct buffer_struct *b, int nr_lanes)
+{
+    int i;
+
+    if (nr_lanes < 1 || nr_lanes > MAX_LANES) {
+        return -EINVAL;
+    }
+    down(&b->sem);
+    if (lock_empty_minor(b)) {
+        up(&b->sem);
+        return -EBUSY;
+    }
+    for (i = 1; i < nr_lanes; i++) {
+        if (!buff_exists(&b->lanes[i].buff)) {
+            if (alloc_buff(&b->lanes[i].buff, b->buff_size, minor_node(b))) {
+                unlock_stages(b);
+                up(&b->sem);
+                return -ENOMEM;
+            }
+        }
+    }
+    for (i = nr_lanes; i < MAX_LANES; i++) {
+        free_buff(&b->lanes[i].buff, b->buff_size);
+    }
+    b->nr_lanes = nr_lanes;
+    if (b->journal != NULL) {
+        journal_log(b, JSEG_CONFIG, 0, 0);
+    }
+    unlock_stages(b);
+    up(&b->sem);
+    return 0;
+}
+
+// Resize every lane of an empty minor. The new buffers are charged before the
+// old ones are released, so the change fails cleanly when over budget.
+static int set_capacity(struct buffer_struct *b, int size)
+{
+    struct buff_struct new_buff[MAX_LANES];
+    int i;
+
+    if (size < 1) {
+        return -EINVAL;
+    }
+    down(&b->sem);
+    if (lock_empty_minor(b)) {
+        up(&b->sem);
+        return -EBUSY;
+    }
+    for (i = 0; i < b->nr_lanes; i++) {
+        if (alloc_buff(&new_buff[i], size, minor_node(b))) {
+            while (--i >= 0) {
+                free_buff(&new_buff[i], size);
+            }
+            unlock_stages(b);
+            up(&b->sem);
+            return -ENOMEM;
+        }
+    }
+    for (i = 0; i < b->nr_lanes; i++) {
+        free_buff(&b->lanes[i].buff, b->buff_size);
+        b->lanes[i].buff = new_buff[i];
+    }
+    b->buff_size = size;
+    memset(b->slots, 0, sizeof(b->slots)); // values do not survive a resize
+    if (b->journal != NULL) {
+        journal_log(b, JSEG_CONFIG, 0, 0);
+    }
+    unlock_stages(b);
+    up(&b->sem);
+    return 0;
+}
+
+// like the lane count, the record format can only change on an empty minor
+static int set_framed(struct buffer_struct *b, int framed)
+{
+    down(&b->sem);
+    if (lock_empty_minor(b)) {
+        up(&b->sem);
+        return -EBUSY;
+    }
+    b->framed = framed ? 1 : 0;
+    if (b->journal != NULL) {
+        journal_log(b, JSEG_CONFIG, 0, 0);
+    }
+    unlock_stages(b);
+    up(&b->sem);
+    return 0;
+}
+
+// Switch an empty minor to or from last-value mode. Stream data and values
+// never mix, so the minor must hold neither.
+static int set_conflate(struct buffer_struct *b, int nr_keys)
+{
+    int i;
+
+    if (nr_keys < 0 || nr_keys > MAX_KEYS) {
+        return -EINVAL;
+    }
+    down(&b->sem);
+    // values are not journaled, nor staged
+    if ((b->journal != NULL || b->stages != NULL) && nr_keys > 0) {
+        up(&b->sem);
+        return -EBUSY;
+    }
+    for (i = 0; i < b->nr_lanes; i++) {
+        if (b->lanes[i].buff_len != 0) {
+            up(&b->sem);
+            return -EBUSY;
+        }
+    }
+    b->nr_keys = nr_keys;
+    memset(b->slots, 0, sizeof(b->slots));
+    up(&b->sem);
+    return 0;
+}
+
+static void frame_time(struct pubsub_frame *frame)
+{
+#if PUBSUB_MODERN
+    struct timespec64 ts;
+
+    ktime_get_real_ts64(&ts);
+    frame->tv_sec = ts.tv_sec;
+    frame->tv_usec = ts.tv_nsec / NSEC_PER_USEC;
+#else
+    struct timeval tv;
+
+    do_gettimeofday(&tv);
+    frame->tv_sec = tv.tv_sec;
+    frame->tv_usec = tv.tv_usec;
+#endif
+    frame->stamp = jiffies;
+}
+
+static void fill_frame(struct buffer_struct *b, struct pdp_strct *pdp_p, struct pubsub_frame *frame, int len)
+{
+    frame_time(frame);
+    frame->len = len;
+    frame->seq = b->seq++;
+    frame->key = pdp_p->key;
+}
+
+// Retention drops the oldest data of a lane whether or not it was read: the
+// rest of the lane moves down to offset 0 and every cursor with it, so the
+// room is the publishers' again. Readers that had not reached the cut lose
+// what was dropped. Raw lanes are cut anywhere for max_bytes and age as a
+// whole, by their last write; framed lanes are cut between records.
+// It runs from reclaim_work, never on the read or write path.
+
+static long ms_jiffies(long ms)
+{
+    return (ms * HZ + 999) / 1000;
+}
+
+// jiffies since a frame was published, by its monotonic stamp: setting the
+// wall clock neither drops records early nor keeps them forever
+static long frame_age(struct pubsub_frame *frame)
+{
+    return (long) ((__u32) jiffies - frame->stamp);
+}
+
+// Move len bytes of the buffer from offset src down to dst.
+static void buff_move(struct buff_struct *bs, int dst, int src, int len)
+{
+    while (len > 0) {
+        int n = len;
+        char *from = buff_area(bs, src, &n);
+        char *to = buff_area(bs, dst, &n);
+
+        memmove(to, from, n);
+        dst += n;
+        src += n;
+        len -= n;
+    }
+}
+
+// unpin a record retention dropped before its lane reset
+static void zc_drop(struct lane_struct *l, struct zc_record *rec)
+{
+    struct zc_record **pp = &l->zc_records;
+
+    while (*pp != rec) {
+        pp = &(*pp)->next;
+    }
+    *pp = rec->next;
+    zc_release(rec);
+}
+
+static int over_retention(struct buffer_struct *b, struct lane_struct *l)
+{
+    return (b->retain_bytes > 0 && l->buff_len > b->retain_bytes) ||
+           (b->retain_records > 0 && b->framed && l->records > b->retain_records);
+}
+
+// Bytes at the start of a framed lane that are past a limit, dropping their
+// pinned records. *records is set to how many records that is.
+static int framed_cut(struct buffer_struct *b, struct lane_struct *l, int *records)
+{
+    struct pubsub_frame frame;
+    int off = 0;
+
+    *records = 0;
+    while (off < l->buff_len) {
+        int stored;
+
+        buff_copy(&l->buff, off, (char *) &frame, sizeof(frame), BUFF_TO_KERNEL);
+        if (!(b->retain_bytes > 0 && l->buff_len - off > b->retain_bytes) &&
+            !(b->retain_records > 0 && l->records - *records > b->retain_records) &&
+            !(b->retain_ms > 0 && frame_age(&frame) >= ms_jiffies(b->retain_ms))) {
+            break;
+        }
+        if (frame.len & FRAME_ZC) {
+            struct zc_record *rec;
+
+            buff_copy(&l->buff, off + sizeof(frame), (char *) &rec, sizeof(rec), BUFF_TO_KERNEL);
+            zc_drop(l, rec);
+            stored = sizeof(rec);
+        } else {
+            stored = frame.len;
+        }
+        off += sizeof(frame) + stored;
+        (*records) ++;
+    }
+    return off;
+}
+
+static void cut_cursor(struct lane_struct *l, struct cursor_struct *c, int cut, int records)
+{
+    if (c->my_resets != l->global_reset) {
+        return;
+    }
+    if (c->seek >= cut) {
+        c->seek -= cut;
+        c->records -= records;
+    } else {
+        c->seek = 0;
+        c->records = 0;
+    }
+}
+
+// Apply the retention limits to one lane. Called with the semaphore held.
+static void trim_lane(struct buffer_struct *b, struct lane_struct *l)
+{
+    int lane = l - b->lanes;
+    struct list_head *pos;
+    int records = 0;
+    int cut = 0;
+    int i;
+
+    if (b->framed) {
+        cut = framed_cut(b, l, &records);
+    } else if (b->retain_ms > 0 && time_after_eq(jiffies, l->written_at + ms_jiffies(b->retain_ms))) {
+        cut = l->buff_len;
+    } else if (b->retain_bytes > 0 && l->buff_len > b->retain_bytes) {
+        cut = l->buff_len - b->retain_bytes;
+    }
+    if (cut == 0) {
+        return;
+    }
+    b->reclaimed += cut;
+    if (cut == l->buff_len) {
+        reset_lane(b, l);
+        return;
+    }
+
+    buff_move(&l->buff, 0, cut, l->buff_len - cut);
+    l->buff_len -= cut;
+    l->records -= records;
+    // readers that had read everything still have, so finished_sub holds
+    spin_lock_bh(&b->wake_lock);
+    list_for_each(pos, &b->files) {
+        cut_cursor(l, &list_entry(pos, struct pdp_strct, link)->cursor[lane], cut, records);
+    }
+    spin_unlock_bh(&b->wake_lock);
+    for (i = 0; i < MAX_GROUPS; i++) {
+        if (group_in_use(&b->groups[i])) {
+            cut_cursor(l, &b->groups[i].cursor[lane], cut, records);
+        }
+    }
+    if (b->journal != NULL) {
+        journal_log(b, JSEG_TRIM, lane, cut);
+    }
+    wake_up_interruptible(&b->wq);
+}
+
+// jiffies until the oldest data of a lane is past max_age
+static long lane_expiry(struct buffer_struct *b, struct lane_struct *l)
+{
+    struct pubsub_frame frame;
+
+    if (!b->framed) {
+        return (long) (l->written_at + ms_jiffies(b->retain_ms) - jiffies);
+    }
+    buff_copy(&l->buff, 0, (char *) &frame, sizeof(frame), BUFF_TO_KERNEL);
+    return max(ms_jiffies(b->retain_ms) - frame_age(&frame), 0L);
+}
+
+static void reclaim(struct buffer_struct *b)
+{
+    long next = -1;
+    int i;
+
+    down(&b->sem);
+    if (b->nr_keys > 0 || b->reclaim_off) {
+        up(&b->sem);
+        return;
+    }
+    for (i = 0; i < b->nr_lanes; i++) {
+        struct lane_struct *l = &b->lanes[i];
+
+        if (buff_exists(&l->buff) && l->buff_len > 0) {
+            trim_lane(b, l);
+        }
+        if (b->retain_ms > 0 && l->buff_len > 0) {
+            long expiry = max(lane_expiry(b, l), 1L);
+            if (next < 0 || expiry < next) {
+                next = expiry;
+            }
+        }
+    }
+    if (next > 0) {
+        mod_timer(&b->retain_timer, jiffies + next);
+    }
+    up(&b->sem);
+}
+
+// After a publish to the lane: queue the reclaim once a limit is passed,
+// and have the timer queue it when the new data would expire.
+static void retention_check(struct buffer_struct *b, struct lane_struct *l)
+{
+    l->written_at = jiffies;
+    if (b->reclaim_off) {
+        return;
+    }
+    if (over_retention(b, l)) {
+        schedule_pubsub_work(&b->reclaim_work);
+    }
+    if (b->retain_ms > 0 && !timer_pending(&b->retain_timer)) {
+        mod_timer(&b->retain_timer, jiffies + ms_jiffies(b->retain_ms));
+    }
+}
+
+#if PUBSUB_MODERN
+static void retain_timer_fn(struct timer_list *t)
+{
+    schedule_pubsub_work(&container_of(t, struct buffer_struct, retain_timer)->reclaim_work);
+}
+
+static void reclaim_work_fn(struct work_struct *work)
+{
+    reclaim(container_of(work, struct buffer_struct, reclaim_work));
+}
+#else
+static void retain_timer_fn(unsigned long data)
+{
+    schedule_pubsub_work(&((struct buffer_struct *) data)->reclaim_work);
+}
+
+static void reclaim_work_fn(void *data)
+{
+    reclaim((struct buffer_struct *) data);
+}
+#endif
+
+// Wait out the retention timer and reclaim_work of a minor whose reclaim_off
+// is set, so nothing runs on its buffers any more. Called without b->sem,
+// which reclaim takes. The work no longer re-arms the timer, but the timer
+// may queue the work once more until it is deleted.
+static void stop_reclaim(struct buffer_struct *b)
+{
+#if PUBSUB_MODERN
+    cancel_work_sync(&b->reclaim_work);
+    del_timer_sync(&b->retain_timer);
+    cancel_work_sync(&b->reclaim_work);
+#else
+    flush_scheduled_tasks();
+    del_timer_sync(&b->retain_timer);
+    flush_scheduled_tasks();
+#endif
+}
+
+static int set_retention(struct buffer_struct *b, const struct pubsub_retention *arg)
+{
+    if ((int) arg->max_bytes < 0 || (int) arg->max_records < 0 || (int) arg->max_age_ms < 0) {
+        return -EINVAL;
+    }
+    down(&b->sem);
+    if (b->nr_keys > 0) {
+        up(&b->sem);
+        return -EINVAL;
+    }
+    b->retain_bytes = arg->max_bytes;
+    b->retain_records = arg->max_records;
+    b->retain_ms = arg->max_age_ms;
+    up(&b->sem);
+    // what the minor already holds is held to the new limits too
+    schedule_pubsub_work(&b->reclaim_work);
+    return 0;
+}
+
+// Replace the value of the publisher's key. A key not in the table takes an
+// empty slot or evicts the one updated longest ago: publishers never wait.
+static int write_conflated(struct buffer_struct *b, struct pdp_strct *pdp_p, const char *buf, size_t count, int dir)
+{
+    int slot_size = b->buff_size / b->nr_keys;
+    struct lvc_slot *slot = NULL;
+    struct pubsub_frame frame;
+    int i;
+
+    if (count + sizeof(frame) > slot_size) {
+        return -EINVAL;
+    }
+    for (i = 0; i < b->nr_keys; i++) {
+        if (b->slots[i].version != 0 && b->slots[i].key == pdp_p->key) {
+            slot = &b->slots[i];
+            break;
+        }
+    }
+    if (slot == NULL) {
+        slot = &b->slots[0];
+        for (i = 1; i < b->nr_keys; i++) {
+            if (b->slots[i].version < slot->version) {
+                slot = &b->slots[i];
+            }
+        }
+    }
+
+    i = slot - b->slots;
+    slot->version = 0; // a failed copy leaves the slot empty rather than torn
+    if (buff_copy(&b->lanes[0].buff, i * slot_size + sizeof(frame), (char *) buf, count, dir)) {
+        return -EBADF;
+    }
+    fill_frame(b, pdp_p, &frame, count);
+    buff_copy(&b->lanes[0].buff, i * slot_size, (char *) &frame, sizeof(frame), BUFF_FROM_KERNEL);
+    slot->key = pdp_p->key;
+    slot->version = ++b->lvc_version;
+    return count;
+}
+
+// Hand out the values this reader has not seen yet, oldest update first, as
+// many as fit in count and at most max_values.
+static int read_conflated(struct buffer_struct *b, struct pdp_strct *pdp_p, char *buf, size_t count, int max_values,
+                          int dir)
+{
+    unsigned int *seen = pdp_p->group ? pdp_p->group->lvc_seen : pdp_p->lvc_seen;
+    int slot_size = b->buff_size / b->nr_keys;
+    int hdr_len = pdp_p->read_framed ? sizeof(struct pubsub_frame) : 0;
+    int copied = 0;
+    int values = 0;
+    int too_small = 0;
+
+    while (values < max_values) {
+        struct pubsub_frame frame;
+        int next = -1;
+        int i;
+
+        for (i = 0; i < b->nr_keys; i++) {
+            if (b->slots[i].version > seen[i] &&
+                (next < 0 || b->slots[i].version < b->slots[next].version)) {
+                next = i;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        buff_copy(&b->lanes[0].buff, next * slot_size, (char *) &frame, sizeof(frame), BUFF_TO_KERNEL);
+        if (frame.len + hdr_len > count - copied) {
+            too_small = 1;
+            break;
+        }
+        if (buff_copy(&b->lanes[0].buff, next * slot_size + sizeof(frame) - hdr_len, buf + copied,
+                      frame.len + hdr_len, dir)) {
+            return -EBADF;
+        }
+        copied += frame.len + hdr_len;
+        seen[next] = b->slots[next].version;
+        values ++;
+    }
+    if (values == 0) {
+        return too_small ? -EINVAL : -EAGAIN;
+    }
+    return copied;
+}
+
+// Copy whole records of a framed lane from the cursor on, as many as fit in
+// count and at most max_frames. Returns the bytes copied to buf, a user
+// pointer for dir BUFF_TO_USER and a kernel one for BUFF_TO_KERNEL.
+static int copy_frames(struct lane_struct *l, struct cursor_struct *c, char *buf, size_t count,
+                       int with_header, int max_frames, int dir)
+{
+    struct pubsub_frame frame;
+    int copied = 0;
+    int frames = 0;
+
+    while (c->seek < l->buff_len && frames < max_frames) {
+        int hdr_len = with_header ? sizeof(frame) : 0;
+        int stored; // payload bytes the record takes in the lane
+
+        buff_copy(&l->buff, c->seek, (char *) &frame, sizeof(frame), BUFF_TO_KERNEL);
+        if ((frame.len & ~FRAME_ZC) + hdr_len > count - copied) {
+            break;
+        }
+        if (frame.len & FRAME_ZC) {
+            // the payload is read straight from the publisher's pinned pages
+            struct zc_record *rec;
+
+            frame.len &= ~FRAME_ZC;
+            buff_copy(&l->buff, c->seek + sizeof(frame), (char *) &rec, sizeof(rec), BUFF_TO_KERNEL);
+            if ((with_header && copy_dir(buf + copied, (char *) &frame, sizeof(frame), dir)) ||
+                zc_copy(rec, buf + copied + hdr_len, frame.len, dir)) {
+                return -EBADF;
+            }
+            stored = sizeof(rec);
+        } else {
+            if (buff_copy(&l->buff, c->seek + sizeof(frame) - hdr_len, buf + copied, frame.len + hdr_len, dir)) {
+                return -EBADF;
+            }
+            stored = frame.len;
+        }
+        copied += frame.len + hdr_len;
+        c->seek += sizeof(frame) + stored;
+        c->records ++;
+        frames ++;
+    }
+    // a record is never split: the reader has to offer room for the next one
+    if (frames == 0) {
+        return -EINVAL;
+    }
+    return copied;
+}
+
+
+// The state of a new file of the minor: what open sets up, and what
+// SUBSCRIBE_MULTI sets up for every minor it reads. NULL when out of memory.
+static struct pdp_strct *open_file(int minor)
+{
+    struct buffer_struct *b = &buffer_array[minor];
+    //init pdp pointer
+    struct pdp_strct *p = kmalloc ( sizeof (struct pdp_strct), GFP_KERNEL );
+    if (p == NULL) { return NULL;}
+
+    p->minor_id = minor;
+    p->type = TYPE_NONE;
+    p->group = NULL;
+    p->priority = MAX_LANES - 1; // bulk data unless the publisher says otherwise
+    p->read_framed = 0;
+    p->key = 0;
+    memset(p->lvc_seen, 0, sizeof(p->lvc_seen));
+    p->zc_done = 0;
+    p->blocking = 0;
+    init_waitqueue_head(&p->wait);
+    p->lowat_bytes = 0;
+    p->lowat_records = 0;
+    p->max_delay = 0;
+    p->delay_armed = 0;
+    p->merge = NULL;
+    p->parent = NULL;
+    p->spin_max = 0;
+    p->spin_budget = 0;
+    p->avg_gap = 0;
+    p->last_data = 0;
+    p->spins = 0;
+    p->sleeps = 0;
+
+    // the reset of a closed minor, its first buffer and the reference count
+    // change together, so a close racing with the open cannot free the
+    // buffer the new file is given, nor both allocate one
+    down(&b->sem);
+    expire_durable(b);
+    // a closed minor kept only for durable subscriptions that just expired
+    if (b->reference_count == 0 && !has_durable(b) && b->journal == NULL) {
+        reset_minor(b);
+    }
+    b->reclaim_off = 0;
+
+    // check if buffer is initiated, if not then initiate
+    if (!buff_exists(&b->lanes[0].buff)) {
+        if (alloc_buff(&b->lanes[0].buff, b->buff_size, minor_node(b))) {
+            up(&b->sem);
+            kfree(p);
+            return NULL;
+        }
+    }
+    init_cursor(b, p->cursor);
+
+    spin_lock_bh(&b->wake_lock);
+    list_add(&p->link, &b->files);
+    spin_unlock_bh(&b->wake_lock);
+    b->reference_count++;
+    pubsub_trace(TRACE_OPEN, minor, TYPE_NONE, b->reference_count, 0, 0, 0);
+    up(&b->sem);
+    
+    return p;
+}
+
+int my_open(struct inode *inode, struct file *filp)
+{
+    struct pdp_strct *p = open_file(MINOR(inode->i_rdev));
+    if (p == NULL) { return -ENOMEM;}
+
+    filp->private_data = p; // might be &p
+#if PUBSUB_MODERN
+    // reads and writes honour IOCB_NOWAIT, so io_uring may issue them inline
+    filp->f_mode |= FMODE_NOWAIT;
+#endif
+    return 0;
+}
+
+static void close_file(struct pdp_strct *pdp_p)
+{
+    int minor = pdp_p->minor_id;
+    struct buffer_struct *b = &buffer_array[minor];
+    int type = pdp_p->type;
+    int last;
+    int i;
+
+    if (pdp_p->merge != NULL) {
+        for (i = 0; i < pdp_p->merge->nr_minors; i++) {
+            close_file(pdp_p->merge->subs[i]);
+        }
+        kfree(pdp_p->merge);
+    }
+    
+    down(&b->sem);
+    if (pdp_p->type == TYPE_SUB && pdp_p->group == NULL) {
+        remove_subscriber(b, pdp_p->cursor);
+    }
+    if (pdp_p->type == TYPE_PUB) {
+        zc_forget_publisher(b, pdp_p);
+    }
+    if (pdp_p->group != NULL) {
+        pdp_p->group->members --;
+        if (pdp_p->group->members == 0) {
+            if (pdp_p->group->durable) {
+                // keep the cursor (and the data it holds back) for a reopen
+                pdp_p->group->detached_at = jiffies;
+            } else {
+                remove_subscriber(b, pdp_p->group->cursor);
+            }
+        }
+    }
+    spin_lock_bh(&b->wake_lock);
+    list_del(&pdp_p->link);
+    spin_unlock_bh(&b->wake_lock);
+
+    b->reference_count -=1;
+
+    pubsub_trace(TRACE_RELEASE, minor, type, b->reference_count, 0, 0, 0);
+    last = b->reference_count == 0 && !has_durable(b) && b->journal == NULL;
+    if (last) {
+        b->reclaim_off = 1;
+    }
+    up(&b->sem);
+
+    kfree(pdp_p);
+    if (!last) {
+        return;
+    }
+    // a running reclaim must be done with the buffers before they are freed
+    stop_reclaim(b);
+    down(&b->sem);
+    if( b->reference_count == 0 && !has_durable(b) && b->journal == NULL ) {
+        reset_minor(b);
+    } else if (!b->reclaim_off) {
+        // opened again meanwhile: retention goes on where the timer stopped
+        schedule_pubsub_work(&b->reclaim_work);
+    }
+    up(&b->sem);
+}
+
+// Fady: this is called each time we close a fd (is that true?)
+int my_release(struct inode *inode, struct file *filp) // release memory initiated in open
+{
+    close_file((struct pdp_strct *) filp->private_data);
+    return 0;
+}
+
+// The highest priority lane with unread bytes for these cursors, NULL when
+// everything was read. Cursors of lanes reset since they last read restart.
+static struct lane_struct *pick_lane(struct buffer_struct *b, struct cursor_struct *cursors,
+                                     struct cursor_struct **c)
+{
+    int i;
+
+    for (i = 0; i < b->nr_lanes; i++) {
+        struct lane_struct *lane = &b->lanes[i];
+        struct cursor_struct *cursor = &cursors[i];
+
+        //check if the buffer of the file exists
+        if (!buff_exists(&lane->buff)) {
+            return ERR_PTR(-EFAULT);
+        }
+
+        //check if we have to reset
+        if (lane->global_reset != cursor->my_resets) {
+            cursor->seek = 0;
+            cursor->my_resets = lane->global_reset;
+            cursor->records = 0;
+        }
+
+        if (lane->buff_len - cursor->seek > 0) {
+            *c = cursor;
+            return lane;
+        }
+    }
+    return NULL;
+}
+
+// One attempt at a read. nowait fails with -EAGAIN rather than sleeping on
+// the semaphore (IOCB_NOWAIT).
+static ssize_t read_once(struct file *filp, char *buf, size_t count, int nowait, int dir)
+{
+    //find minor
+    struct pdp_strct *pdp_p = (struct pdp_strct *)filp->private_data; 
+    int minor = pdp_p->minor_id;
+    struct buffer_struct *b = &buffer_array[minor];
+    struct lane_struct *l = NULL;
+    struct cursor_struct *c = NULL;
+    int *seek;
+    int read_count;
+
+    //check type
+    if (pdp_p->type != TYPE_SUB && pdp_p->group == NULL) {
+        return -EPERM;
+    }
+    
+    if (nowait) {
+        if (down_trylock(&b->sem)) {
+            pubsub_trace(TRACE_EAGAIN, minor, pdp_p->type, TRACE_BUSY, 0, 0, 0);
+            return -EAGAIN;
+        }
+    } else if (down_interruptible(&b->sem)) {
+        return -ERESTARTSYS;
+    }
+
+    if (b->nr_keys > 0) {
+        // group members take one value each
+        int ret = read_conflated(b, pdp_p, buf, count, pdp_p->group ? 1 : MAX_KEYS, dir);
+        up(&b->sem);
+        pubsub_trace(ret > 0 ? TRACE_READ : TRACE_EAGAIN, minor, pdp_p->type, ret > 0 ? ret : TRACE_NO_DATA,
+                     0, 0, 0);
+        return ret;
+    }
+
+    // what publishers staged is read in order with the rest
+    drain_stages(b);
+    // a read drains a single lane: the highest priority one with unread bytes
+    l = pick_lane(b, reader_cursor(pdp_p), &c);
+    if (IS_ERR(l)) {
+        up(&b->sem);
+        return PTR_ERR(l);
+    }
+
+    //check if there is something to read
+    if (l == NULL) {
+        up(&b->sem);
+        pubsub_trace(TRACE_EAGAIN, minor, pdp_p->type, TRACE_NO_DATA, 0, 0, 0);
+        return -EAGAIN;
+    }
+
+    seek = &c->seek;
+
+    if (b->framed) {
+        // group members take one record each so the group's work is spread out
+        read_count = copy_frames(l, c, buf, count, pdp_p->read_framed, pdp_p->group ? 1 : b->buff_size, dir);
+        if (read_count < 0) {
+            up(&b->sem);
+            return read_count;
+        }
+    } else {
+        // find how much to read
+        read_count = l->buff_len - *seek;
+        if (count < read_count) {
+            read_count = count;
+        }
+
+        // copy to the reader buffer, starting where this cursor stopped
+        if (buff_copy(&l->buff, *seek, buf, read_count, dir)) {
+            up(&b->sem);
+            return -EBADF;
+        }
+
+        // update seek according to the amount read.
+        *seek += read_count;
+    }
+    if ( *seek == l->buff_len) {
+        l->finished_sub += 1;
+    }
+    // whatever is left unread starts a new max_delay
+    spin_lock_bh(&b->wake_lock);
+    pdp_p->delay_armed = 0;
+    spin_unlock_bh(&b->wake_lock);
+    pubsub_trace(TRACE_READ, minor, pdp_p->type, read_count, *seek, l->global_reset, l - b->lanes);
+    // check if all subs are done reading
+    check_all_finished(b, l);
+
+    up(&b->sem);
+    return read_count; 
+}
+
+// whether a read by this file would find something; used as a wait
+// condition, so it looks at the minor without taking the semaphore
+static int reader_has_data(struct buffer_struct *b, struct pdp_strct *pdp_p)
+{
+    struct cursor_struct *cursor = reader_cursor(pdp_p);
+    int i;
+
+    if (b->nr_keys > 0) {
+        unsigned int *seen = pdp_p->group ? pdp_p->group->lvc_seen : pdp_p->lvc_seen;
+        for (i = 0; i < b->nr_keys; i++) {
+            if (b->slots[i].version > seen[i]) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    for (i = 0; i < b->nr_lanes; i++) {
+        int seek = cursor[i].my_resets == b->lanes[i].global_reset ? cursor[i].seek : 0;
+        if (b->lanes[i].buff_len > seek) {
+            return 1;
+        }
+    }
+    // a read drains the stages first, unless they wait for a lane reset
+    return b->staged && !b->stage_stalled;
+}
+
+static int is_reader(struct pdp_strct *pdp_p)
+{
+    return pdp_p->type == TYPE_SUB || pdp_p->group != NULL;
+}
+
+// the subscribers of a merged file wake the file itself
+static wait_queue_head_t *reader_wait(struct pdp_strct *pdp_p)
+{
+    return pdp_p->parent ? &pdp_p->parent->wait : &pdp_p->wait;
+}
+
+// A reader is ready, for blocking reads and poll, once its unread data
+// reaches one of its watermarks or has waited max_delay. Watermarks do not
+// apply to conflating minors, and record watermarks only to framed ones.
+static int reader_ready(struct buffer_struct *b, struct pdp_strct *pdp_p)
+{
+    struct cursor_struct *cursor = reader_cursor(pdp_p);
+    int use_records = pdp_p->lowat_records > 0 && b->framed;
+    int bytes = 0;
+    int records = 0;
+    int i;
+
+    if (!reader_has_data(b, pdp_p)) {
+        return 0;
+    }
+    if (b->nr_keys > 0 || (pdp_p->lowat_bytes == 0 && !use_records)) {
+        return 1;
+    }
+    if (pdp_p->delay_armed && time_after_eq(jiffies, pdp_p->deadline)) {
+        return 1;
+    }
+    for (i = 0; i < b->nr_lanes; i++) {
+        struct lane_struct *l = &b->lanes[i];
+        if (cursor[i].my_resets == l->global_reset) {
+            bytes += l->buff_len - cursor[i].seek;
+            records += l->records - cursor[i].records;
+        } else {
+            bytes += l->buff_len;
+            records += l->records;
+        }
+    }
+    return (pdp_p->lowat_bytes > 0 && bytes >= pdp_p->lowat_bytes) ||
+           (use_records && records >= pdp_p->lowat_records);
+}
+
+// Start the max_delay of a reader that has data below its watermark.
+// Called with wake_lock held.
+static void arm_delay(struct buffer_struct *b, struct pdp_strct *pdp_p)
+{
+    if (pdp_p->max_delay == 0 || pdp_p->delay_armed) {
+        return;
+    }
+    pdp_p->delay_armed = 1;
+    pdp_p->deadline = jiffies + pdp_p->max_delay;
+    if (!timer_pending(&b->wake_timer) || time_before(pdp_p->deadline, b->wake_timer.expires)) {
+        mod_timer(&b->wake_timer, pdp_p->deadline);
+    }
+}
+
+// After a publish: wake only the readers whose watermark is reached, and
+// let the others wait for more data or their max_delay.
+static void wake_readers(struct buffer_struct *b)
+{
+    struct list_head *pos;
+
+    spin_lock_bh(&b->wake_lock);
+    list_for_each(pos, &b->files) {
+        struct pdp_strct *p = list_entry(pos, struct pdp_strct, link);
+        if (!is_reader(p)) {
+            continue;
+        }
+        if (reader_ready(b, p)) {
+            wake_up_interruptible(reader_wait(p));
+        } else if (reader_has_data(b, p)) {
+            arm_delay(b, p);
+        }
+    }
+    spin_unlock_bh(&b->wake_lock);
+}
+
+// wake_timer: wake the readers whose max_delay ran out, rearm for the rest
+static void wake_expired(struct buffer_struct *b)
+{
+    struct list_head *pos;
+    unsigned long next = 0;
+    int pending = 0;
+
+    spin_lock(&b->wake_lock);
+    list_for_each(pos, &b->files) {
+        struct pdp_strct *p = list_entry(pos, struct pdp_strct, link);
+        if (!p->delay_armed) {
+            continue;
+        }
+        if (time_after_eq(jiffies, p->deadline)) {
+            wake_up_interruptible(reader_wait(p));
+        } else if (!pending || time_before(p->deadline, next)) {
+            next = p->deadline;
+            pending = 1;
+        }
+    }
+    if (pending) {
+        mod_timer(&b->wake_timer, next);
+    }
+    spin_unlock(&b->wake_lock);
+}
+
+#if PUBSUB_MODERN
+static void wake_timer_fn(struct timer_list *t)
+{
+    wake_expired(container_of(t, struct buffer_struct, wake_timer));
+}
+#else
+static void wake_timer_fn(unsigned long data)
+{
+    wake_expired((struct buffer_struct *) data);
+}
+#endif
+
+static int writer_has_room(struct buffer_struct *b, struct pdp_strct *pdp_p)
+{
+    struct lane_struct *l = &b->lanes[min(pdp_p->priority, b->nr_lanes - 1)];
+    int hdr_len = b->framed ? sizeof(struct pubsub_frame) : 0;
+
+    return b->nr_keys > 0 || l->buff_len + hdr_len < b->buff_size;
+}
+
+static int merged_has_data(struct pdp_strct *pdp_p)
+{
+    struct merge_struct *m = pdp_p->merge;
+    int i;
+
+    for (i = 0; i < m->nr_minors; i++) {
+        if (reader_has_data(&buffer_array[m->subs[i]->minor_id], m->subs[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int lock_minor(struct buffer_struct *b, int nowait)
+{
+    if (nowait) {
+        if (down_trylock(&b->sem)) {
+            return -EAGAIN;
+        }
+    } else if (down_interruptible(&b->sem)) {
+        return -ERESTARTSYS;
+    }
+    drain_stages(b);
+    return 0;
+}
+
+// The header of the next record of a merged file's subscriber, -EAGAIN when
+// it has none. Raw minors have no publish time and count as oldest.
+static int peek_record(struct pdp_strct *sub, struct pubsub_frame *frame, int nowait)
+{
+    struct buffer_struct *b = &buffer_array[sub->minor_id];
+    struct lane_struct *l;
+    struct cursor_struct *c;
+    int ret = lock_minor(b, nowait);
+    int i;
+
+    if (ret) {
+        return ret;
+    }
+    ret = -EAGAIN;
+    memset(frame, 0, sizeof(*frame));
+    if (b->nr_keys > 0) {
+        int next = -1;
+        for (i = 0; i < b->nr_keys; i++) {
+            if (b->slots[i].version > sub->lvc_seen[i] &&
+                (next < 0 || b->slots[i].version < b->slots[next].version)) {
+                next = i;
+            }
+        }
+        if (next >= 0) {
+            buff_copy(&b->lanes[0].buff, next * (b->buff_size / b->nr_keys), (char *) frame, sizeof(*frame),
+                      BUFF_TO_KERNEL);
+            ret = 0;
+        }
+    } else {
+        l = pick_lane(b, sub->cursor, &c);
+        if (l != NULL && !IS_ERR(l)) {
+            if (b->framed) {
+                buff_copy(&l->buff, c->seek, (char *) frame, sizeof(*frame), BUFF_TO_KERNEL);
+            }
+            ret = 0;
+        }
+    }
+    up(&b->sem);
+    return ret;
+}
+
+// Hand one record of a merged file's subscriber to the reader behind a
+// struct pubsub_merged header. -EAGAIN when it has none, -EINVAL when the
+// record does not fit in count.
+static int read_record(struct pdp_strct *sub, char *buf, size_t count, int nowait, int dir)
+{
+    struct buffer_struct *b = &buffer_array[sub->minor_id];
+    struct pubsub_merged hdr;
+    struct lane_struct *l;
+    struct cursor_struct *c;
+    int tag_len = sizeof(hdr.minor);
+    int ret;
+
+    if (count <= sizeof(hdr)) {
+        return -EINVAL;
+    }
+    hdr.minor = sub->minor_id;
+    if (copy_dir(buf, (char *) &hdr.minor, tag_len, dir)) {
+        return -EFAULT;
+    }
+    ret = lock_minor(b, nowait);
+    if (ret) {
+        return ret;
+    }
+    if (b->nr_keys > 0) {
+        ret = read_conflated(b, sub, buf + tag_len, count - tag_len, 1, dir);
+        up(&b->sem);
+        return ret > 0 ? ret + tag_len : ret;
+    }
+
+    l = pick_lane(b, sub->cursor, &c);
+    if (l == NULL || IS_ERR(l)) {
+        up(&b->sem);
+        return l == NULL ? -EAGAIN : PTR_ERR(l);
+    }
+    if (b->framed) {
+        ret = copy_frames(l, c, buf + tag_len, count - tag_len, 1, 1, dir);
+        if (ret > 0) {
+            ret += tag_len;
+        }
+    } else {
+        // what a raw minor holds unread becomes one record, never split:
+        // it stays whole for a read with room for it
+        memset(&hdr.frame, 0, sizeof(hdr.frame));
+        hdr.frame.len = l->buff_len - c->seek;
+        if (hdr.frame.len > count - sizeof(hdr)) {
+            ret = -EINVAL;
+        } else if (copy_dir(buf, (char *) &hdr, sizeof(hdr), dir) ||
+                   buff_copy(&l->buff, c->seek, buf + sizeof(hdr), hdr.frame.len, dir)) {
+            ret = -EBADF;
+        } else {
+            c->seek += hdr.frame.len;
+            ret = sizeof(hdr) + hdr.frame.len;
+        }
+    }
+    if (ret > 0) {
+        if (c->seek == l->buff_len) {
+            l->finished_sub += 1;
+        }
+        check_all_finished(b, l);
+    }
+    up(&b->sem);
+    return ret;
+}
+
+// the subscriber whose next record was published first, -1 if none has one
+static int oldest_sub(struct merge_struct *m, int nowait)
+{
+    struct pubsub_frame frame;
+    __u32 sec = 0;
+    __u32 usec = 0;
+    int oldest = -1;
+    int i;
+
+    for (i = 0; i < m->nr_minors; i++) {
+        if (peek_record(m->subs[i], &frame, nowait)) {
+            continue;
+        }
+        if (oldest < 0 || frame.tv_sec < sec || (frame.tv_sec == sec && frame.tv_usec < usec)) {
+            oldest = i;
+            sec = frame.tv_sec;
+            usec = frame.tv_usec;
+        }
+    }
+    return oldest;
+}
+
+// Fill the reader's buffer with whole records of the merged minors, one
+// minor at a time under its own semaphore.
+static ssize_t merged_read(struct pdp_strct *pdp_p, char *buf, size_t count, int nowait, int dir)
+{
+    struct merge_struct *m = pdp_p->merge;
+    int copied = 0;
+    int idle = 0; // subscribers in a row the fair order found empty
+    int ret = -EAGAIN;
+
+    while (idle < m->nr_minors) {
+        int i = m->order == PUBSUB_MERGE_TIME ? oldest_sub(m, nowait) : m->next;
+
+        if (i < 0) {
+            break;
+        }
+        ret = read_record(m->subs[i], buf + copied, count - copied, nowait, dir);
+        if (ret == -EAGAIN && m->order == PUBSUB_MERGE_FAIR) {
+            m->next = (i + 1) % m->nr_minors;
+            idle ++;
+            continue;
+        }
+        if (ret < 0) {
+            break;
+        }
+        copied += ret;
+        idle = 0;
+        if (m->order == PUBSUB_MERGE_FAIR) {
+            m->next = (i + 1) % m->nr_minors;
+        }
+    }
+    // a record that does not fit stays first for the next read
+    return copied > 0 ? copied : ret;
+}
+
+static u64 now_us(void)
+{
+#if PUBSUB_MODERN
+    return ktime_to_us(ktime_get());
+#else
+    struct timeval tv;
+
+    do_gettimeofday(&tv);
+    return (u64) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+// A SET_SPIN reader busy-waits for data for its spin budget before it goes
+// to sleep, so a record that comes soon is handed over without a wakeup.
+// Whether it came is what the reader's spin/sleep counts record.
+static int spin_for_data(struct buffer_struct *b, struct pdp_strct *pdp_p)
+{
+    u64 start = now_us();
+
+    while (!reader_ready(b, pdp_p)) {
+        if (pdp_p->spin_budget == 0 || pubsub_need_resched() || signal_pending(current) ||
+            now_us() - start >= pdp_p->spin_budget) {
+            pdp_p->sleeps ++;
+            return 0;
+        }
+        cpu_relax();
+    }
+    pdp_p->spins ++;
+    return 1;
+}
+
+// Spinning only pays when records come within the spin: the budget is twice
+// the recent gap between records, and 0 while they are further apart than
+// spin_max, until they speed up again.
+static void spin_adapt(struct pdp_strct *pdp_p)
+{
+    u64 now = now_us();
+
+    if (pdp_p->last_data != 0) {
+        unsigned int gap = min(now - pdp_p->last_data, (u64) MAX_SPIN_US * 16);
+
+        pdp_p->avg_gap = pdp_p->avg_gap ? (pdp_p->avg_gap * 7 + gap) / 8 : gap;
+        pdp_p->spin_budget = pdp_p->avg_gap > pdp_p->spin_max ? 0 :
+                             min(pdp_p->avg_gap * 2, (unsigned int) pdp_p->spin_max);
+    }
+    pdp_p->last_data = now;
+}
+
+// A file that asked for SET_BLOCKING sleeps until it is ready to read,
+// unless the caller said not to block.
+static ssize_t pubsub_read(struct file *filp, char *buf, size_t count, int nonblock, int nowait, int dir)
+{
+    struct pdp_strct *pdp_p = (struct pdp_strct *) filp->private_data;
+    struct buffer_struct *b = &buffer_array[pdp_p->minor_id];
+    ssize_t ret;
+
+    for (;;) {
+        if (pdp_p->blocking && !nonblock && pdp_p->merge != NULL) {
+            if (wait_event_interruptible(pdp_p->wait, merged_has_data(pdp_p))) {
+                return -ERESTARTSYS;
+            }
+        } else if (pdp_p->blocking && !nonblock && is_reader(pdp_p) &&
+                   !(pdp_p->spin_max > 0 && spin_for_data(b, pdp_p))) {
+            spin_lock_bh(&b->wake_lock);
+            if (reader_has_data(b, pdp_p)) {
+                arm_delay(b, pdp_p);
+            }
+            spin_unlock_bh(&b->wake_lock);
+            if (wait_event_interruptible(pdp_p->wait, reader_ready(b, pdp_p))) {
+                return -ERESTARTSYS;
+            }
+        }
+        if (pdp_p->merge != NULL) {
+            ret = merged_read(pdp_p, buf, count, nowait, dir);
+        } else {
+            ret = read_once(filp, buf, count, nowait, dir);
+        }
+        if (ret > 0 && pdp_p->spin_max > 0) {
+            spin_adapt(pdp_p);
+        }
+        if (ret != -EAGAIN || nonblock || !pdp_p->blocking) {
+            return ret;
+        }
+    }
+}
+
+ssize_t my_read(struct file *filp, char *buf, size_t count, loff_t *f_pos)
+{
+    return pubsub_read(filp, buf, count, filp->f_flags & O_NONBLOCK, 0, BUFF_TO_USER);
+}
+
+unsigned int my_poll(struct file *filp, poll_table *wait)
+{
+    struct pdp_strct *pdp_p = (struct pdp_strct *) filp->private_data;
+    struct buffer_struct *b = &buffer_array[pdp_p->minor_id];
+    unsigned int mask = 0;
+
+    poll_wait(filp, &pdp_p->wait, wait);
+    poll_wait(filp, &b->wq, wait);
+    // the same lockless checks blocking reads wait on: poll never sleeps
+    // behind a long PUBLISH_MULTI or journal write holding the semaphore
+    if (is_reader(pdp_p)) {
+        spin_lock_bh(&b->wake_lock);
+        if (reader_ready(b, pdp_p)) {
+            mask |= POLLIN | POLLRDNORM;
+        } else if (reader_has_data(b, pdp_p)) {
+            arm_delay(b, pdp_p);
+        }
+        spin_unlock_bh(&b->wake_lock);
+    }
+    if (pdp_p->merge != NULL && merged_has_data(pdp_p)) {
+        mask |= POLLIN | POLLRDNORM;
+    }
+    if (pdp_p->type == TYPE_PUB && writer_has_room(b, pdp_p)) {
+        mask |= POLLOUT | POLLWRNORM;
+    }
+    return mask;
+}
+
+static int check_lane_room(struct buffer_struct *b, struct lane_struct *l, size_t count);
+
+// Whether a record of count bytes from this publisher fits in the minor now.
+// Called with the minor's semaphore held.
+static int check_room(struct buffer_struct *b, struct pdp_strct *pdp_p, size_t count)
+{
+    if (b->nr_keys > 0) {
+        return count + sizeof(struct pubsub_frame) > b->buff_size / b->nr_keys ? -EINVAL : 0;
+    }
+    // priorities past the minor's lane count fall into its lowest lane
+    return check_lane_room(b, &b->lanes[min(pdp_p->priority, b->nr_lanes - 1)], count);
+}
+
+// whether a record of count bytes fits in the lane now
+static int check_lane_room(struct buffer_struct *b, struct lane_struct *l, size_t count)
+{
+    // a framed record takes its header's worth of buffer space as well
+    int hdr_len = b->framed ? sizeof(struct pubsub_frame) : 0;
+    int remaining_buffer_spcae;
+
+    //check inside buffer size
+    if (count + hdr_len > b->buff_size) {
+        return -EINVAL;
+    }
+
+    //check remaining space
+    // a lane held back by a long gone durable subscriber is released first
+    if (count + hdr_len > b->buff_size - l->buff_len) {
+        expire_durable(b);
+    }
+    remaining_buffer_spcae = b->buff_size - l->buff_len;
+    if (count + hdr_len > remaining_buffer_spcae ) {
+        pubsub_trace(TRACE_EAGAIN, b->minor, TYPE_PUB, TRACE_NO_ROOM, l->buff_len, l->global_reset, count);
+        return -EAGAIN;
+    }
+
+    //check if the buffer of the file exists
+    if (!buff_exists(&l->buff)) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+// Append one record to a minor whose semaphore is held. buf is a user
+// pointer for dir BUFF_FROM_USER and a kernel one for BUFF_FROM_KERNEL.
+static int store_record(struct buffer_struct *b, struct lane_struct *l, struct pubsub_frame *frame,
+                        const char *buf, size_t count, int dir);
+
+// Append without draining the stages, for a caller that drained them when it
+// checked the room.
+static int append_drained(struct buffer_struct *b, struct pdp_strct *pdp_p, const char *buf, size_t count,
+                          int dir)
+{
+    struct pubsub_frame frame;
+    int ret;
+
+    if (b->nr_keys > 0) {
+        ret = write_conflated(b, pdp_p, buf, count, dir);
+        if (ret > 0) {
+            wake_readers(b);
+        }
+        return ret;
+    }
+    ret = check_room(b, pdp_p, count);
+    if (ret) {
+        return ret;
+    }
+    frame_time(&frame);
+    frame.key = pdp_p->key;
+    ret = store_record(b, &b->lanes[min(pdp_p->priority, b->nr_lanes - 1)], &frame, buf, count, dir);
+    return ret ? ret : count;
+}
+
+static int append_record(struct buffer_struct *b, struct pdp_strct *pdp_p, const char *buf, size_t count, int dir)
+{
+    // records written directly go after the staged ones
+    drain_stages(b);
+    return append_drained(b, pdp_p, buf, count, dir);
+}
+
+// Store a record that fits in lane l and make it visible. frame carries the
+// publish time and key of a framed record; its len and seq are set here.
+static int store_record(struct buffer_struct *b, struct lane_struct *l, struct pubsub_frame *frame,
+                        const char *buf, size_t count, int dir)
+{
+    int hdr_len = b->framed ? sizeof(struct pubsub_frame) : 0;
+
+    //copy from user to our buffer
+    if (buff_copy(&l->buff, l->buff_len + hdr_len, (char *) buf, count, dir)) {
+        return -EBADF;
+    }
+    if (b->framed) {
+        frame->len = count;
+        frame->seq = b->seq++;
+        buff_copy(&l->buff, l->buff_len, (char *) frame, sizeof(*frame), BUFF_FROM_KERNEL);
+    }
+    l->buff_len += count + hdr_len;
+    if (b->journal != NULL) {
+        journal_data(b, l - b->lanes, l->buff_len - count - hdr_len, count + hdr_len);
+    }
+    // subscribers that were at the old end have new bytes to read again
+    if (count + hdr_len > 0) {
+        l->finished_sub = 0;
+        l->records ++;
+        wake_readers(b);
+        retention_check(b, l);
+    }
+    pubsub_trace(TRACE_WRITE, b->minor, TYPE_PUB, count, l->buff_len, l->global_reset, l - b->lanes);
+    return 0;
+}
+
+// High fan-in minors: publishers append to the staging area of the CPU they
+// run on instead of taking the minor's semaphore, so they only contend with
+// publishers on the same CPU, and touch nothing shared but the first record
+// of an empty stage. Publishers never drain: a reader or drain_work moves the
+// staged records into the lanes, merging the stages by the time they were
+// staged.
+
+// when a record was staged: ns of the monotonic clock, us of the time of day
+// on 2.4, which has no clock that is both fine grained and the same on all CPUs
+static u64 stage_clock(void)
+{
+#if PUBSUB_MODERN
+    return ktime_get_ns();
+#else
+    struct timeval tv;
+
+    do_gettimeofday(&tv);
+    return (u64) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static void free_stages(struct buffer_struct *b)
+{
+    int i;
+
+    if (b->stages == NULL) {
+        return;
+    }
+    for (i = 0; i < nr_stages(); i++) {
+        kfree(b->stages[i].data);
+    }
+    kfree(b->stages);
+    uncharge_budget((long) nr_stages() * b->stage_size);
+    b->stages = NULL;
+    b->stage_size = 0;
+    b->fanin = 0;
+    b->staged = 0;
+    b->stage_stalled = 0;
+}
+
+// Staging areas live until the minor is reset: publishers use them without
+// the semaphore, so turning the mode off only stops new records.
+static int set_fanin(struct buffer_struct *b, int size)
+{
+    int i;
+
+    if (size < 0 || size > KMALLOC_MAX_BUFF) {
+        return -EINVAL;
+    }
+    down(&b->sem);
+    if (size == 0) {
+        b->fanin = 0;
+        drain_stages(b);
+        up(&b->sem);
+        return 0;
+    }
+    if (b->nr_keys > 0 || size < sizeof(struct staged_hdr)) {
+        up(&b->sem);
+        return -EINVAL;
+    }
+    if (b->stages != NULL) {
+        if (size != b->stage_size) {
+            up(&b->sem);
+            return -EBUSY;
+        }
+        b->fanin = 1;
+        up(&b->sem);
+        return 0;
+    }
+    if (charge_budget((long) nr_stages() * size)) {
+        up(&b->sem);
+        return -ENOMEM;
+    }
+    b->stages = kmalloc(nr_stages() * sizeof(struct stage_struct), GFP_KERNEL);
+    if (b->stages == NULL) {
+        uncharge_budget((long) nr_stages() * size);
+        up(&b->sem);
+        return -ENOMEM;
+    }
+    memset(b->stages, 0, nr_stages() * sizeof(struct stage_struct));
+    b->stage_size = size;
+    for (i = 0; i < nr_stages(); i++) {
+        init_MUTEX(&b->stages[i].sem);
+        b->stages[i].data = kmalloc(size, GFP_KERNEL);
+        if (b->stages[i].data == NULL) {
+            free_stages(b);
+            up(&b->sem);
+            return -ENOMEM;
+        }
+    }
+    // publishers look at fanin first: the areas must be there when it is set
+    wmb();
+    b->fanin = 1;
+    up(&b->sem);
+    return 0;
+}
+
+static void lock_stages(struct buffer_struct *b)
+{
+    int i;
+
+    for (i = 0; b->stages != NULL && i < nr_stages(); i++) {
+        down(&b->stages[i].sem);
+    }
+}
+
+// compact what the drain left in each stage and let publishers stage again
+static void unlock_stages(struct buffer_struct *b)
+{
+    int i;
+
+    if (b->stages == NULL) {
+        return;
+    }
+    b->staged = 0;
+    for (i = 0; i < nr_stages(); i++) {
+        struct stage_struct *st = &b->stages[i];
+
+        if (st->head > 0) {
+            memmove(st->data, st->data + st->head, st->len - st->head);
+            st->len -= st->head;
+            st->head = 0;
+        }
+        if (st->len > 0) {
+            b->staged = 1;
+        }
+        up(&st->sem);
+    }
+}
+
+// Settings that change what fits in a lane only apply to an empty minor.
+// Staged records count as data, their publishers were told they are
+// published: they are drained first, and the stages stay locked until
+// unlock_stages() so that nothing is staged for the old settings meanwhile.
+// Called with the semaphore held; on -EBUSY the stages are not locked.
+static int lock_empty_minor(struct buffer_struct *b)
+{
+    int i;
+
+    drain_stages(b);
+    lock_stages(b);
+    for (i = 0; i < b->nr_lanes; i++) {
+        if (b->lanes[i].buff_len != 0) {
+            unlock_stages(b);
+            return -EBUSY;
+        }
+    }
+    if (b->staged) {
+        unlock_stages(b);
+        return -EBUSY;
+    }
+    return 0;
+}
+
+// Move the staged records into the lanes, oldest stamp first, the lower CPU
+// on a tie. A record without room stops the drain, so the order holds, until
+// the next lane reset schedules drain_work. Called with the semaphore held.
+static void drain_stages(struct buffer_struct *b)
+{
+    int i;
+
+    if (b->stages == NULL) {
+        return;
+    }
+    lock_stages(b);
+    b->stage_stalled = 0;
+    for (;;) {
+        struct stage_struct *next = NULL;
+        struct staged_hdr hdr, oldest;
+        struct lane_struct *l;
+        int ret;
+
+        for (i = 0; i < nr_stages(); i++) {
+            struct stage_struct *st = &b->stages[i];
+
+            if (st->head == st->len) {
+                continue;
+            }
+            memcpy(&hdr, st->data + st->head, sizeof(hdr));
+            if (next == NULL || hdr.stamp < oldest.stamp) {
+                next = st;
+                oldest = hdr;
+            }
+        }
+        if (next == NULL) {
+            break;
+        }
+        l = &b->lanes[min(oldest.lane, b->nr_lanes - 1)];
+        ret = check_lane_room(b, l, oldest.frame.len);
+        if (ret == -EAGAIN) {
+            b->stage_stalled = 1;
+            break;
+        }
+        // lock_empty_minor() keeps the lanes as they were when the record
+        // was staged, so it fits; anything else is skipped, not retried
+        if (ret == 0) {
+            store_record(b, l, &oldest.frame, next->data + next->head + sizeof(oldest), oldest.frame.len,
+                         BUFF_FROM_KERNEL);
+        }
+        next->head += sizeof(oldest) + oldest.frame.len;
+    }
+    unlock_stages(b);
+}
+
+#if PUBSUB_MODERN
+static void drain_work_fn(struct work_struct *work)
+{
+    struct buffer_struct *b = container_of(work, struct buffer_struct, drain_work);
+#else
+static void drain_work_fn(void *data)
+{
+    struct buffer_struct *b = (struct buffer_struct *) data;
+#endif
+
+    down(&b->sem);
+    drain_stages(b);
+    up(&b->sem);
+}
+
+// Append a record to this CPU's staging area. The first record of an empty
+// area schedules drain_work, which empties every area it finds; a full area
+// returns -EAGAIN until it has.
+static ssize_t stage_record(struct buffer_struct *b, struct pdp_strct *pdp_p, const char *buf, size_t count,
+                            int nowait, int dir)
+{
+    int rec_len = sizeof(struct staged_hdr) + count;
+    struct stage_struct *st = &b->stages[stage_cpu() % nr_stages()];
+    struct staged_hdr hdr;
+    int was_empty;
+
+    if (rec_len > b->stage_size) {
+        return -EINVAL;
+    }
+    if (nowait ? down_trylock(&st->sem) : down_interruptible(&st->sem)) {
+        return nowait ? -EAGAIN : -ERESTARTSYS;
+    }
+    // the lane settings do not change while a stage is locked
+    if (count + (b->framed ? sizeof(struct pubsub_frame) : 0) > b->buff_size) {
+        up(&st->sem);
+        return -EINVAL;
+    }
+    if (st->len + rec_len > b->stage_size) {
+        up(&st->sem);
+        pubsub_trace(TRACE_EAGAIN, b->minor, TYPE_PUB, TRACE_STAGE_FULL, st->len, 0, count);
+        return -EAGAIN;
+    }
+    if (copy_dir(st->data + st->len + sizeof(hdr), buf, count, dir)) {
+        up(&st->sem);
+        return -EBADF;
+    }
+    hdr.stamp = stage_clock();
+    hdr.lane = pdp_p->priority;
+    frame_time(&hdr.frame);
+    hdr.frame.len = count;
+    hdr.frame.key = pdp_p->key;
+    memcpy(st->data + st->len, &hdr, sizeof(hdr));
+    was_empty = st->len == 0;
+    st->len += rec_len;
+    if (was_empty) {
+        b->staged = 1;
+    }
+    up(&st->sem);
+    // a stage that already held records has a drain coming, or waits for a
+    // lane reset that schedules one
+    if (was_empty) {
+        schedule_pubsub_work(&b->drain_work);
+    }
+    return count;
+}
+
+// Writes never wait for room. With nowait (IOCB_NOWAIT) they do not wait for
+// the semaphore or for journal I/O either. dir is BUFF_FROM_USER or
+// BUFF_FROM_KERNEL.
+static ssize_t write_once(struct file *filp, const char *buf, size_t count, int nowait, int dir) {
+    //find minor
+    struct pdp_strct *pdp_p = (struct pdp_strct *)filp->private_data; 
+    int minor = pdp_p->minor_id;
+    struct buffer_struct *b = &buffer_array[minor];
+    int ret;
+
+    //check type
+    if (pdp_p->type != TYPE_PUB) {
+        return -EPERM;
+    }
+    if (b->fanin) {
+        rmb();
+        return stage_record(b, pdp_p, buf, count, nowait, dir);
+    }
+
+    if (nowait) {
+        if (down_trylock(&b->sem)) {
+            pubsub_trace(TRACE_EAGAIN, minor, TYPE_PUB, TRACE_BUSY, 0, 0, count);
+            return -EAGAIN;
+        }
+        if (b->journal != NULL) {
+            up(&b->sem);
+            return -EAGAIN;
+        }
+    } else if (down_interruptible(&b->sem)) {
+        return -ERESTARTSYS;
+    }
+
+    ret = append_record(b, pdp_p, buf, count, dir);
+    up(&b->sem);
+    return ret;
+}
+
+ssize_t my_write(struct file *filp, const char *buf, size_t count, loff_t *f_pos)
+{
+    return write_once(filp, buf, count, 0, BUFF_FROM_USER);
+}
+
+#if PUBSUB_MODERN
+// A read or write of an iov_iter is one transfer over all of its segments:
+// a write is one record, and a read hands out whole records. A single user
+// buffer (read(), write(), most io_uring requests) is used in place; iovecs
+// and io_uring's registered buffers go through a kernel bounce buffer.
+static ssize_t my_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    int nowait = (iocb->ki_flags & IOCB_NOWAIT) != 0;
+    int nonblock = nowait || (iocb->ki_filp->f_flags & O_NONBLOCK);
+    size_t count = iov_iter_count(to);
+    char *bounce;
+    ssize_t ret;
+
+    if (count == 0) {
+        return 0;
+    }
+    if (iter_is_ubuf(to)) {
+        ret = pubsub_read(iocb->ki_filp, (char *) iter_iov_addr(to), count, nonblock, nowait, BUFF_TO_USER);
+        if (ret > 0) {
+            iov_iter_advance(to, ret);
+        }
+        return ret;
+    }
+    count = min(count, (size_t) MAX_BOUNCE_LEN);
+    bounce = kvmalloc(count, GFP_KERNEL);
+    if (bounce == NULL) {
+        return -ENOMEM;
+    }
+    ret = pubsub_read(iocb->ki_filp, bounce, count, nonblock, nowait, BUFF_TO_KERNEL);
+    if (ret > 0 && copy_to_iter(bounce, ret, to) != ret) {
+        ret = -EFAULT;
+    }
+    kvfree(bounce);
+    return ret;
+}
+
+static ssize_t my_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    int nowait = (iocb->ki_flags & IOCB_NOWAIT) != 0;
+    size_t count = iov_iter_count(from);
+    char *bounce;
+    ssize_t ret;
+
+    if (count == 0) {
+        return 0;
+    }
+    if (iter_is_ubuf(from)) {
+        ret = write_once(iocb->ki_filp, (const char *) iter_iov_addr(from), count, nowait, BUFF_FROM_USER);
+        if (ret > 0) {
+            iov_iter_advance(from, ret);
+        }
+        return ret;
+    }
+    // a record is never split, so it has to fit in the bounce buffer whole
+    if (count > MAX_BOUNCE_LEN) {
+        return -EINVAL;
+    }
+    bounce = kvmalloc(count, GFP_KERNEL);
+    if (bounce == NULL) {
+        return -ENOMEM;
+    }
+    if (copy_from_iter(bounce, count, from) != count) {
+        kvfree(bounce);
+        return -EFAULT;
+    }
+    ret = write_once(iocb->ki_filp, bounce, count, nowait, BUFF_FROM_KERNEL);
+    kvfree(bounce);
+    return ret;
+}
+#endif
+
+
+// Publish a record without copying it: the publisher's pages are pinned and
+// linked into the lane, and subscribers read the payload from them directly.
+// Only framed minors can hold such records, and journaled ones never do.
+static int publish_zc(struct buffer_struct *b, struct pdp_strct *pdp_p, const struct pubsub_zc *arg)
+{
+    struct pubsub_frame frame;
+    struct zc_record *rec;
+    struct lane_struct *l;
+    int rec_len = sizeof(frame) + sizeof(rec);
+    int ret;
+
+    ret = zc_pin(arg->buf, arg->len, &rec);
+    if (ret) {
+        return ret;
+    }
+
+    down(&b->sem);
+    if (!b->framed || b->nr_keys > 0 || b->journal != NULL) {
+        ret = -EINVAL;
+        goto out;
+    }
+    l = &b->lanes[min(pdp_p->priority, b->nr_lanes - 1)];
+    if (rec_len > b->buff_size - l->buff_len) {
+        expire_durable(b);
+    }
+    if (rec_len > b->buff_size - l->buff_len) {
+        ret = -EAGAIN;
+        goto out;
+    }
+
+    fill_frame(b, pdp_p, &frame, arg->len);
+    frame.len |= FRAME_ZC;
+    buff_copy(&l->buff, l->buff_len, (char *) &frame, sizeof(frame), BUFF_FROM_KERNEL);
+    buff_copy(&l->buff, l->buff_len + sizeof(frame), (char *) &rec, sizeof(rec), BUFF_FROM_KERNEL);
+    l->buff_len += rec_len;
+    l->finished_sub = 0;
+    rec->publisher = pdp_p;
+    rec->next = l->zc_records;
+    l->zc_records = rec;
+    l->records ++;
+    wake_readers(b);
+    retention_check(b, l);
+    up(&b->sem);
+    return 0;
+
+out:
+    up(&b->sem);
+    zc_release(rec);
+    return ret;
+}
+
+// records outlive the file that published them; nobody is left to count them
+static void zc_forget_publisher(struct buffer_struct *b, struct pdp_strct *pdp_p)
+{
+    struct zc_record *rec;
+    int i;
+
+    for (i = 0; i < MAX_LANES; i++) {
+        for (rec = b->lanes[i].zc_records; rec != NULL; rec = rec->next) {
+            if (rec->publisher == pdp_p) {
+                rec->publisher = NULL;
+            }
+        }
+    }
+}
+
+// Publish one payload to several minors, copying it from the user once.
+// Best effort appends to each target in turn. PUBSUB_ALL_OR_NOTHING locks
+// every target first, in minor order so that two of these cannot deadlock,
+// and appends only when all of them have room.
+static int publish_multi(struct pdp_strct *pdp_p, struct pubsub_multi *m)
+{
+    int order[MAX_TARGETS];
+    int n = m->nr_targets;
+    int locked = 0;
+    int ret = 0;
+    char *data;
+    int i, j;
+
+    memset(m->results, 0, sizeof(m->results));
+    if (n < 1 || n > MAX_TARGETS || m->len > MAX_MULTI_LEN) {
+        return -EINVAL;
+    }
+    for (i = 0; i < n; i++) {
+        if (m->minors[i] >= MINOR_NUM) {
+            return -EINVAL;
+        }
+        for (j = 0; j < i; j++) {
+            if (m->minors[j] == m->minors[i]) {
+                return -EINVAL;
+            }
+        }
+    }
+    data = m->len <= KMALLOC_MAX_BUFF ? kmalloc(m->len + 1, GFP_KERNEL) : vmalloc(m->len);
+    if (data == NULL) {
+        return -ENOMEM;
+    }
+    if (copy_from_user(data, m->buf, m->len)) {
+        ret = -EFAULT;
+        goto out;
+    }
+
+    if (!(m->flags & PUBSUB_ALL_OR_NOTHING)) {
+        for (i = 0; i < n; i++) {
+            struct buffer_struct *b = &buffer_array[m->minors[i]];
+
+            down(&b->sem);
+            // a closed minor would be reset by its next open
+            m->results[i] = b->reference_count > 0 ? append_record(b, pdp_p, data, m->len, BUFF_FROM_KERNEL) : -ENXIO;
+            up(&b->sem);
+            if (m->results[i] >= 0) {
+                ret ++;
+            }
+        }
+        goto out;
+    }
+
+    for (i = 0; i < n; i++) {
+        for (j = i; j > 0 && m->minors[order[j - 1]] > m->minors[i]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    // staged records go first: drained now, they cannot take the room checked below
+    for (locked = 0; locked < n; locked++) {
+        ret = lock_minor(&buffer_array[m->minors[order[locked]]], 0);
+        if (ret) {
+            goto unlock;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        struct buffer_struct *b = &buffer_array[m->minors[i]];
+
+        m->results[i] = b->reference_count > 0 ? check_room(b, pdp_p, m->len) : -ENXIO;
+        if (m->results[i] < 0 && ret == 0) {
+            ret = m->results[i];
+        }
+    }
+    if (ret == 0) {
+        // every target was checked under its lock, so none of these fails
+        for (i = 0; i < n; i++) {
+            m->results[i] = append_drained(&buffer_array[m->minors[i]], pdp_p, data, m->len, BUFF_FROM_KERNEL);
+        }
+        ret = n;
+    }
+unlock:
+    while (locked > 0) {
+        up(&buffer_array[m->minors[order[--locked]]].sem);
+    }
+out:
+    if (m->len <= KMALLOC_MAX_BUFF) {
+        kfree(data);
+    } else {
+        vfree(data);
+    }
+    return ret;
+}
+
+// Turn a TYPE_NONE file into a merged reader of the given minors: it gets a
+// subscriber of its own on each, as if it had opened them all.
+static int subscribe_multi(struct pdp_strct *pdp_p, struct pubsub_merge *arg)
+{
+    struct merge_struct *m;
+    int i, j;
+
+    if (arg->nr_minors < 1 || arg->nr_minors > MAX_TARGETS ||
+        (arg->order != PUBSUB_MERGE_FAIR && arg->order != PUBSUB_MERGE_TIME)) {
+        return -EINVAL;
+    }
+    for (i = 0; i < arg->nr_minors; i++) {
+        if (arg->minors[i] >= MINOR_NUM) {
+            return -EINVAL;
+        }
+        for (j = 0; j < i; j++) {
+            if (arg->minors[j] == arg->minors[i]) {
+                return -EINVAL;
+            }
+        }
+    }
+    m = kmalloc(sizeof(struct merge_struct), GFP_KERNEL);
+    if (m == NULL) {
+        return -ENOMEM;
+    }
+    m->order = arg->order;
+    m->nr_minors = 0;
+    m->next = 0;
+    for (i = 0; i < arg->nr_minors; i++) {
+        struct pdp_strct *sub = open_file(arg->minors[i]);
+        struct buffer_struct *b = &buffer_array[arg->minors[i]];
+
+        if (sub == NULL) {
+            while (m->nr_minors > 0) {
+                close_file(m->subs[--m->nr_minors]);
+            }
+            kfree(m);
+            return -ENOMEM;
+        }
+        sub->parent = pdp_p;
+        sub->read_framed = 1;
+        down(&b->sem);
+        sub->type = TYPE_SUB;
+        b->sub_counter ++;
+        up(&b->sem);
+        m->subs[m->nr_minors++] = sub;
+    }
+    pdp_p->merge = m;
+    pdp_p->type = TYPE_MERGED;
+    return 0;
+}
+
+// Attach a file to the named group, creating it on first join. A TYPE_SUB
+// file joining a durable subscription gives up its own cursor for it.
+static int join_group(struct buffer_struct *b, struct pdp_strct *pdp_p, const char *user_name, int durable)
+{
+    char name[GROUP_NAME_LEN];
+    struct group_struct *free_slot = NULL;
+    int i;
+
+    if (copy_from_user(name, user_name, GROUP_NAME_LEN)) {
+        return -EFAULT;
+    }
+    name[GROUP_NAME_LEN - 1] = '\0';
+
+    down(&b->sem);
+    expire_durable(b);
+    for (i = 0; i < MAX_GROUPS; i++) {
+        struct group_struct *g = &b->groups[i];
+        if (!group_in_use(g)) {
+            if (free_slot == NULL) {
+                free_slot = g;
+            }
+            continue;
+        }
+        if (strncmp(g->name, name, GROUP_NAME_LEN) == 0) {
+            if (pdp_p->type == TYPE_SUB) {
+                remove_subscriber(b, pdp_p->cursor);
+            }
+            g->members ++;
+            g->durable |= durable;
+            pdp_p->group = g;
+            up(&b->sem);
+            return 0;
+        }
+    }
+    if (free_slot == NULL) {
+        up(&b->sem);
+        return -ENOSPC;
+    }
+    if (pdp_p->type == TYPE_SUB) {
+        remove_subscriber(b, pdp_p->cursor);
+    }
+
+    // a new group starts like a new subscriber: from the start of the buffer
+    memcpy(free_slot->name, name, GROUP_NAME_LEN);
+    free_slot->members = 1;
+    free_slot->durable = durable;
+    memset(free_slot->lvc_seen, 0, sizeof(free_slot->lvc_seen));
+    init_cursor(b, free_slot->cursor);
+    b->sub_counter ++;
+    pdp_p->group = free_slot;
+    up(&b->sem);
+    return 0;
+}
+
+int my_ioctl(struct inode *inode, struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct pdp_strct *pdp_p = (struct pdp_strct *) filp->private_data;
+    int minor = pdp_p->minor_id;
+    struct pubsub_zc zc;
+    struct pubsub_multi multi;
+    struct pubsub_merge merge;
+    struct pubsub_retention retention;
+    struct pubsub_spin_stats spin;
+    int ret;
+
+    pubsub_trace(TRACE_IOCTL, minor, pdp_p->type, _IOC_NR(cmd), 0, 0, arg);
+    switch(cmd)
+    {
+    case SET_TYPE:
+        if ((arg !=TYPE_PUB) && (arg != TYPE_SUB) && (arg != TYPE_GROUP)) {
+            return -EINVAL;
+        }
+        if (pdp_p->type != TYPE_NONE) {
+            return -EPERM;
+        }
+        pdp_p->type = arg;
+        if (pdp_p->type == TYPE_PUB) {
+            // a minor's buffers follow its first publisher to its node
+            down(&buffer_array[minor].sem);
+            if (buffer_array[minor].node < 0) {
+                place_minor(&buffer_array[minor], numa_node_id());
+            }
+            up(&buffer_array[minor].sem);
+        }
+        if (pdp_p->type == TYPE_SUB) {
+            down(&buffer_array[minor].sem);
+            buffer_array[minor].sub_counter ++;
+            up(&buffer_array[minor].sem);
+        }
+        return 0;
+	break;
+    case GET_TYPE:
+        /*if ((pdp_p->type != TYPE_PUB) && (pdp_p != TYPE_SUB)) {
+            return TYPE_NONE;
+        }*/
+        return pdp_p->type;
+	break;
+    case JOIN_GROUP:
+        if (pdp_p->type != TYPE_GROUP || pdp_p->group != NULL) {
+            return -EPERM;
+        }
+        return join_group(&buffer_array[minor], pdp_p, (const char *) arg, 0);
+	break;
+    case JOIN_DURABLE:
+        if ((pdp_p->type != TYPE_SUB && pdp_p->type != TYPE_GROUP) || pdp_p->group != NULL) {
+            return -EPERM;
+        }
+        return join_group(&buffer_array[minor], pdp_p, (const char *) arg, 1);
+	break;
+    case LEAVE_DURABLE:
+        if (pdp_p->group == NULL || !pdp_p->group->durable) {
+            return -EINVAL;
+        }
+        // close_file drops the cursor once the last member is gone
+        down(&buffer_array[minor].sem);
+        pdp_p->group->durable = 0;
+        up(&buffer_array[minor].sem);
+        return 0;
+	break;
+    case SET_LANES:
+        return set_lanes(&buffer_array[minor], arg);
+	break;
+    case SET_PRIORITY:
+        if (pdp_p->type != TYPE_PUB) {
+            return -EPERM;
+        }
+        if (arg >= MAX_LANES) {
+            return -EINVAL;
+        }
+        pdp_p->priority = arg;
+        return 0;
+	break;
+    case SET_FRAMED:
+        return set_framed(&buffer_array[minor], arg);
+	break;
+    case SET_CAPACITY:
+        return set_capacity(&buffer_array[minor], arg);
+	break;
+    case SET_CONFLATE:
+        return set_conflate(&buffer_array[minor], arg);
+	break;
+    case SET_KEY:
+        if (pdp_p->type != TYPE_PUB) {
+            return -EPERM;
+        }
+        pdp_p->key = arg;
+        return 0;
+	break;
+    case SET_PERSIST:
+        return set_persist(&buffer_array[minor], minor, arg);
+	break;
+    case PUBLISH_ZC:
+        if (pdp_p->type != TYPE_PUB) {
+            return -EPERM;
+        }
+        if (copy_from_user(&zc, (const struct pubsub_zc *) arg, sizeof(zc))) {
+            return -EFAULT;
+        }
+        return publish_zc(&buffer_array[minor], pdp_p, &zc);
+	break;
+    case GET_ZC_DONE:
+        if (pdp_p->type != TYPE_PUB) {
+            return -EPERM;
+        }
+        return pdp_p->zc_done;
+	break;
+    case SET_READ_FRAMED:
+        pdp_p->read_framed = arg ? 1 : 0;
+        return 0;
+	break;
+    case SET_BLOCKING:
+        pdp_p->blocking = arg ? 1 : 0;
+        return 0;
+	break;
+    case SET_LOWAT:
+        if ((int) arg < 0) {
+            return -EINVAL;
+        }
+        pdp_p->lowat_bytes = arg;
+        return 0;
+	break;
+    case SET_LOWAT_RECORDS:
+        if ((int) arg < 0) {
+            return -EINVAL;
+        }
+        pdp_p->lowat_records = arg;
+        return 0;
+	break;
+    case PUBLISH_MULTI:
+        if (pdp_p->type != TYPE_PUB) {
+            return -EPERM;
+        }
+        if (copy_from_user(&multi, (struct pubsub_multi *) arg, sizeof(multi))) {
+            return -EFAULT;
+        }
+        ret = publish_multi(pdp_p, &multi);
+        if (copy_to_user(((struct pubsub_multi *) arg)->results, multi.results, sizeof(multi.results))) {
+            return -EFAULT;
+        }
+        return ret;
+	break;
+    case SUBSCRIBE_MULTI:
+        if (pdp_p->type != TYPE_NONE) {
+            return -EPERM;
+        }
+        if (copy_from_user(&merge, (struct pubsub_merge *) arg, sizeof(merge))) {
+            return -EFAULT;
+        }
+        return subscribe_multi(pdp_p, &merge);
+	break;
+    case SET_RETENTION:
+        if (copy_from_user(&retention, (struct pubsub_retention *) arg, sizeof(retention))) {
+            return -EFAULT;
+        }
+        return set_retention(&buffer_array[minor], &retention);
+	break;
+    case SET_NODE:
+        return set_node(&buffer_array[minor], (int) arg);
+	break;
+    case SET_FANIN:
+        return set_fanin(&buffer_array[minor], (int) arg);
+	break;
+    case SET_SPIN:
+        if (arg > MAX_SPIN_US) {
+            return -EINVAL;
+        }
+        pdp_p->spin_max = arg;
+        // spin the whole budget until there are gaps to go by
+        pdp_p->spin_budget = arg;
+        pdp_p->avg_gap = 0;
+        pdp_p->last_data = 0;
+        return 0;
+	break;
+    case GET_SPIN_STATS:
+        spin.spins = pdp_p->spins;
+        spin.sleeps = pdp_p->sleeps;
+        spin.budget_us = pdp_p->spin_budget;
+        spin.avg_gap_us = pdp_p->avg_gap;
+        return copy_to_user((struct pubsub_spin_stats *) arg, &spin, sizeof(spin)) ? -EFAULT : 0;
+	break;
+    case SET_TRACE:
+#if PUBSUB_MODERN
+        // tracefs enables the tracepoints, each on its own
+        return -EOPNOTSUPP;
+#else
+        // the mask is global: it traces every minor
+        if (!capable(CAP_SYS_ADMIN)) {
+            return -EPERM;
+        }
+        if (arg >= (1 << NR_TRACE_EVENTS)) {
+            return -EINVAL;
+        }
+        trace_mask = arg;
+        return 0;
+#endif
+	break;
+    case SET_MAX_DELAY:
+        spin_lock_bh(&buffer_array[minor].wake_lock);
+        pdp_p->max_delay = (arg * HZ + 999) / 1000;
+        pdp_p->delay_armed = 0;
+        spin_unlock_bh(&buffer_array[minor].wake_lock);
+        return 0;
+	break;
+    default:
+	return -ENOTTY;
+    }
+
+    return 0;
+}
+
+#if PUBSUB_MODERN
+static long my_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    return my_ioctl(file_inode(filp), filp, cmd, arg);
+}
+
+#ifdef CONFIG_COMPAT
+// struct pubsub_zc as a 32 bit process lays it out
+struct pubsub_zc32 {
+    compat_uptr_t buf;
+    __u32 len;
+};
+#define PUBLISH_ZC32 _IOW(MY_MAGIC, 12, struct pubsub_zc32)
+
+struct pubsub_multi32 {
+    compat_uptr_t buf;
+    __u32 len;
+    __u32 flags;
+    __u32 nr_targets;
+    __u32 minors[MAX_TARGETS];
+    __s32 results[MAX_TARGETS];
+};
+#define PUBLISH_MULTI32 _IOWR(MY_MAGIC, 18, struct pubsub_multi32)
+
+static long my_compat_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct pdp_strct *pdp_p = (struct pdp_strct *) filp->private_data;
+    struct pubsub_zc32 zc32;
+    struct pubsub_zc zc;
+    struct pubsub_multi32 multi32;
+    struct pubsub_multi multi;
+    int ret;
+
+    switch (cmd) {
+    case PUBLISH_ZC32:
+        if (pdp_p->type != TYPE_PUB) {
+            return -EPERM;
+        }
+        if (copy_from_user(&zc32, compat_ptr(arg), sizeof(zc32))) {
+            return -EFAULT;
+        }
+        zc.buf = compat_ptr(zc32.buf);
+        zc.len = zc32.len;
+        return publish_zc(&buffer_array[pdp_p->minor_id], pdp_p, &zc);
+    case PUBLISH_MULTI32:
+        if (pdp_p->type != TYPE_PUB) {
+            return -EPERM;
+        }
+        if (copy_from_user(&multi32, compat_ptr(arg), sizeof(multi32))) {
+            return -EFAULT;
+        }
+        multi.buf = compat_ptr(multi32.buf);
+        multi.len = multi32.len;
+        multi.flags = multi32.flags;
+        multi.nr_targets = multi32.nr_targets;
+        memcpy(multi.minors, multi32.minors, sizeof(multi.minors));
+        ret = publish_multi(pdp_p, &multi);
+        if (copy_to_user(((struct pubsub_multi32 *) compat_ptr(arg))->results, multi.results, sizeof(multi.results))) {
+            return -EFAULT;
+        }
+        return ret;
+    case JOIN_GROUP:
+    case JOIN_DURABLE:
+    case SUBSCRIBE_MULTI:
+    case SET_RETENTION:
+    case GET_SPIN_STATS:
+        // their structs are laid out the same by 32 bit processes
+        arg = (unsigned long) compat_ptr(arg);
+        break;
+    }
+    return my_unlocked_ioctl(filp, cmd, arg);
+}
+#endif
+#endif
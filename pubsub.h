@@ -7,7 +7,99 @@
 #define TYPE_NONE 0
 #define TYPE_PUB 1
 #define TYPE_SUB 2
+#define TYPE_GROUP 3 // competing consumer: members of a group share one cursor
+#define TYPE_MERGED 4 // reads several minors at once, see SUBSCRIBE_MULTI
 
+#define GROUP_NAME_LEN 32
+#define MAX_LANES 4 // lane 0 has the highest priority
+#define MAX_KEYS 16 // key slots of a conflating minor
+#define MAX_TARGETS 32 // minors a single PUBLISH_MULTI writes to
+
+// Header my_write puts in front of every record of a framed minor. Readers
+// that asked for SET_READ_FRAMED get it back in front of each payload.
+struct pubsub_frame {
+    __u32 len;      // payload bytes following the header
+    __u32 seq;      // per-minor sequence number, +1 for every record
+    __u32 tv_sec;   // publish time (wall clock)
+    __u32 tv_usec;
+    __u32 key;      // key the publisher set with SET_KEY
+    __u32 stamp;    // publish jiffies: retention's clock, which the wall clock moving does not affect
+};
+
+// Argument of PUBLISH_ZC: the publisher's buffer, which stays pinned and must
+// not be modified until GET_ZC_DONE counts the record as released.
+struct pubsub_zc {
+    const void *buf;
+    __u32 len;
+};
+
+// Argument of PUBLISH_MULTI: one payload appended to every listed minor
+// (each must be open), with the publisher's priority and key.
+#define PUBSUB_ALL_OR_NOTHING 1 // publish to every target or to none of them
+
+struct pubsub_multi {
+    const void *buf;
+    __u32 len;
+    __u32 flags;
+    __u32 nr_targets;
+    __u32 minors[MAX_TARGETS];
+    __s32 results[MAX_TARGETS]; // out: len when published, 0 when skipped, or a negative errno
+};
+
+// Argument of SUBSCRIBE_MULTI: the minors a TYPE_NONE file starts reading,
+// as a subscriber of each, and how their records are interleaved.
+#define PUBSUB_MERGE_FAIR 0 // one record of every minor in turn
+#define PUBSUB_MERGE_TIME 1 // oldest publish time first
+
+struct pubsub_merge {
+    __u32 order;
+    __u32 nr_minors;
+    __u32 minors[MAX_TARGETS];
+};
+
+// What a merged file reads in front of every record. Records of raw minors
+// get a frame with only len set: all the minor held unread, returned whole.
+struct pubsub_merged {
+    __u32 minor;
+    struct pubsub_frame frame;
+};
+
+// Argument of SET_RETENTION: how much of a minor is kept whether or not it
+// was read, 0 for no limit. What is past a limit is dropped in the background.
+struct pubsub_retention {
+    __u32 max_bytes;
+    __u32 max_records; // framed minors only
+    __u32 max_age_ms;
+};
+
+// Result of GET_SPIN_STATS: how the blocking reads of a SET_SPIN file waited.
+struct pubsub_spin_stats {
+    __u32 spins;      // reads whose data came while they spun
+    __u32 sleeps;     // reads that went to sleep
+    __u32 budget_us;  // how long the next read spins
+    __u32 avg_gap_us; // recent time between the file's reads that returned data
+};
+
+// Traced events. On current kernels each is a tracepoint of its own,
+// events/pubsub/pubsub_<event> in tracefs, enabled there. On 2.4 they go to
+// the /proc/pubsub_trace ring: SET_TRACE (CAP_SYS_ADMIN, or the trace_mask
+// module parameter) takes a mask of (1 << TRACE_x) bits, and tracing costs
+// one test per site while its bit is off.
+#define TRACE_OPEN 0
+#define TRACE_RELEASE 1
+#define TRACE_READ 2   // value: bytes read
+#define TRACE_WRITE 3  // value: bytes written
+#define TRACE_IOCTL 4  // value: the ioctl's number, arg: its argument
+#define TRACE_RESET 5  // a lane was handed back to the publishers
+#define TRACE_EAGAIN 6 // value: one of the causes below
+#define NR_TRACE_EVENTS 7
+
+#define TRACE_NO_DATA 1 // a read found nothing to read
+#define TRACE_NO_ROOM 2 // a write did not fit in its lane
+#define TRACE_BUSY 3    // a nowait call found the minor locked
+#define TRACE_STAGE_FULL 4 // a fan-in publisher's staging area is full until drain_work empties it
+
+#ifdef __KERNEL__
 //
 // Function prototypes
 //
@@ -21,8 +113,36 @@ ssize_t my_write(struct file *, const char *, size_t, loff_t *);
 
 int my_ioctl(struct inode *inode, struct file *filp, unsigned int cmd, unsigned long arg);
 
+unsigned int my_poll(struct file *filp, struct poll_table_struct *wait);
+#endif
+
 #define MY_MAGIC 'r'
 #define SET_TYPE  _IO(MY_MAGIC, 0)
 #define GET_TYPE  _IO(MY_MAGIC, 1)
+#define JOIN_GROUP _IOW(MY_MAGIC, 2, char[GROUP_NAME_LEN]) // arg: pointer to the group name
+#define SET_LANES _IO(MY_MAGIC, 3)    // arg: number of priority lanes of the minor, 1..MAX_LANES
+#define SET_PRIORITY _IO(MY_MAGIC, 4) // arg: lane the publisher's writes go to
+#define SET_FRAMED _IO(MY_MAGIC, 5)   // arg: 1 to keep record boundaries and headers on the minor
+#define SET_READ_FRAMED _IO(MY_MAGIC, 6) // arg: 1 to receive a struct pubsub_frame before every payload
+#define SET_CAPACITY _IO(MY_MAGIC, 7) // arg: bytes per lane buffer of the minor
+#define SET_CONFLATE _IO(MY_MAGIC, 8) // arg: key slots of a last-value minor, 0 for a normal stream
+#define SET_KEY _IO(MY_MAGIC, 9)      // arg: key of the publisher's following writes
+#define JOIN_DURABLE _IOW(MY_MAGIC, 10, char[GROUP_NAME_LEN]) // arg: name of a subscription kept across close
+#define SET_PERSIST _IO(MY_MAGIC, 11) // arg: 1 to journal the minor to persist_dir and restore it on load
+#define PUBLISH_ZC _IOW(MY_MAGIC, 12, struct pubsub_zc) // arg: record published from pinned pages, no copy
+#define GET_ZC_DONE _IO(MY_MAGIC, 13) // returns how many of the file's PUBLISH_ZC records were released
+#define SET_BLOCKING _IO(MY_MAGIC, 14) // arg: 1 for reads that wait for data (unless O_NONBLOCK) instead of EAGAIN
+#define SET_LOWAT _IO(MY_MAGIC, 15)   // arg: unread bytes before a waiting reader is woken, 0 for any
+#define SET_LOWAT_RECORDS _IO(MY_MAGIC, 16) // arg: unread records of a framed minor before a wakeup
+#define SET_MAX_DELAY _IO(MY_MAGIC, 17) // arg: ms a reader below its watermark waits at most, 0 = no limit
+#define PUBLISH_MULTI _IOWR(MY_MAGIC, 18, struct pubsub_multi) // returns the number of targets published to
+#define SUBSCRIBE_MULTI _IOW(MY_MAGIC, 19, struct pubsub_merge) // makes the file TYPE_MERGED
+#define SET_RETENTION _IOW(MY_MAGIC, 20, struct pubsub_retention) // not for conflating minors
+#define SET_NODE _IO(MY_MAGIC, 21) // arg: NUMA node the minor's buffers live on, -1 to follow its publisher
+#define SET_FANIN _IO(MY_MAGIC, 22) // arg: bytes of per-CPU staging for publishers, 0 to write directly
+#define SET_SPIN _IO(MY_MAGIC, 23) // arg: longest spin in us of a blocking read before it sleeps, 0 to never spin
+#define GET_SPIN_STATS _IOR(MY_MAGIC, 24, struct pubsub_spin_stats)
+#define SET_TRACE _IO(MY_MAGIC, 25) // arg: mask of the TRACE_x events the 2.4 ring records, 0 to stop
+#define LEAVE_DURABLE _IO(MY_MAGIC, 26) // the file's durable subscription ends with its last member
 
 #endif
@@ -0,0 +1,150 @@
+#!/usr/bin/python
+#
+# Python bindings of libpubsub (make lib): the device's ioctls, batched
+# publishing and record reads without re-encoding _IOC in every script.
+#
+
+import ctypes
+import os
+
+TYPE_NONE = 0
+TYPE_PUB = 1
+TYPE_SUB = 2
+TYPE_GROUP = 3
+TYPE_MERGED = 4
+
+PUBSUB_MERGE_FAIR = 0
+PUBSUB_MERGE_TIME = 1
+
+DEVICE_PATH = '/dev/pubsub'
+
+
+class Frame(ctypes.Structure):
+    """struct pubsub_frame"""
+    _fields_ = [('len', ctypes.c_uint32),
+                ('seq', ctypes.c_uint32),
+                ('tv_sec', ctypes.c_uint32),
+                ('tv_usec', ctypes.c_uint32),
+                ('key', ctypes.c_uint32)]
+
+
+_lib = ctypes.CDLL(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libpubsub.so'),
+                   use_errno=True)
+_lib.ps_open.restype = ctypes.c_void_p
+_lib.ps_open.argtypes = [ctypes.c_char_p, ctypes.c_int]
+for _name in ('ps_close', 'ps_fd', 'ps_flush', 'ps_flush_expired', 'ps_flush_timeout', 'ps_zc_done'):
+    getattr(_lib, _name).argtypes = [ctypes.c_void_p]
+for _name in ('ps_set_framed', 'ps_set_priority', 'ps_set_blocking', 'ps_set_lanes',
+              'ps_set_capacity', 'ps_wait'):
+    getattr(_lib, _name).argtypes = [ctypes.c_void_p, ctypes.c_int]
+_lib.ps_set_key.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+_lib.ps_set_retention.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_uint, ctypes.c_uint]
+_lib.ps_join_group.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_int]
+_lib.ps_subscribe_multi.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint), ctypes.c_int,
+                                    ctypes.c_int]
+_lib.ps_publish.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+_lib.ps_set_batch.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_uint]
+_lib.ps_set_rx.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+_lib.ps_read.restype = ctypes.c_ssize_t
+_lib.ps_read.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+_lib.ps_next.restype = ctypes.c_ssize_t
+_lib.ps_next.argtypes = [ctypes.c_void_p, ctypes.POINTER(Frame), ctypes.POINTER(ctypes.c_void_p)]
+
+
+def _check(ret):
+    if ret < 0:
+        e = ctypes.get_errno()
+        raise OSError(e, os.strerror(e))
+    return ret
+
+
+def _bytes(s):
+    return s.encode() if not isinstance(s, bytes) else s
+
+
+class Client(object):
+    """One open file of the device, see libpubsub.h for every call."""
+
+    def __init__(self, path=DEVICE_PATH, type=TYPE_NONE):
+        self._c = _lib.ps_open(_bytes(path), type)
+        if not self._c:
+            _check(-1)
+
+    def close(self):
+        if self._c:
+            c, self._c = self._c, None
+            _check(_lib.ps_close(c))
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def fileno(self):
+        return _lib.ps_fd(self._c)
+
+    def set_framed(self, framed=True):
+        _check(_lib.ps_set_framed(self._c, int(framed)))
+
+    def set_priority(self, lane):
+        _check(_lib.ps_set_priority(self._c, lane))
+
+    def set_key(self, key):
+        _check(_lib.ps_set_key(self._c, key))
+
+    def set_blocking(self, blocking=True):
+        _check(_lib.ps_set_blocking(self._c, int(blocking)))
+
+    def set_lanes(self, nr_lanes):
+        _check(_lib.ps_set_lanes(self._c, nr_lanes))
+
+    def set_capacity(self, size):
+        _check(_lib.ps_set_capacity(self._c, size))
+
+    def set_retention(self, max_bytes=0, max_records=0, max_age_ms=0):
+        _check(_lib.ps_set_retention(self._c, max_bytes, max_records, max_age_ms))
+
+    def join_group(self, name, durable=False):
+        _check(_lib.ps_join_group(self._c, _bytes(name), int(durable)))
+
+    def subscribe_multi(self, minors, order=PUBSUB_MERGE_FAIR):
+        arr = (ctypes.c_uint * len(minors))(*minors)
+        _check(_lib.ps_subscribe_multi(self._c, arr, len(minors), order))
+
+    def set_batch(self, size, flush_ms):
+        _check(_lib.ps_set_batch(self._c, size, flush_ms))
+
+    def publish(self, data):
+        data = _bytes(data)
+        _check(_lib.ps_publish(self._c, data, len(data)))
+
+    def flush(self):
+        _check(_lib.ps_flush(self._c))
+
+    def flush_expired(self):
+        _check(_lib.ps_flush_expired(self._c))
+
+    def flush_timeout(self):
+        return _lib.ps_flush_timeout(self._c)
+
+    def zc_done(self):
+        return _check(_lib.ps_zc_done(self._c))
+
+    def wait(self, timeout_ms=-1):
+        return _check(_lib.ps_wait(self._c, timeout_ms)) == 1
+
+    def read(self, size):
+        buf = ctypes.create_string_buffer(size)
+        n = _check(_lib.ps_read(self._c, buf, size))
+        return buf.raw[:n]
+
+    def set_rx(self, size):
+        _check(_lib.ps_set_rx(self._c, size))
+
+    def next(self):
+        """The next record of a framed minor as (Frame, payload)."""
+        frame = Frame()
+        payload = ctypes.c_void_p()
+        n = _check(_lib.ps_next(self._c, ctypes.byref(frame), ctypes.byref(payload)))
+        return frame, ctypes.string_at(payload, n)
@@ -0,0 +1,63 @@
+// The tracepoints of current kernels, one per TRACE_x event (2.4 keeps the
+// events SET_TRACE selects in the /proc/pubsub_trace ring). pubsub.c
+// includes it with CREATE_TRACE_POINTS; each event shows up as
+// events/pubsub/pubsub_<event> in tracefs and is enabled there on its own,
+// one line per event formatted like the ring's. A disabled event costs its
+// site a patched-out branch.
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pubsub
+
+#if !defined(_PUBSUB_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _PUBSUB_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(pubsub_class,
+
+    TP_PROTO(int minor, int type, int value, int seek, int resets, unsigned long arg),
+
+    TP_ARGS(minor, type, value, seek, resets, arg),
+
+    TP_STRUCT__entry(
+        __field(int, minor)
+        __field(int, type)
+        __field(int, value)
+        __field(int, seek)
+        __field(int, resets)
+        __field(unsigned long, arg)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->type = type;
+        __entry->value = value;
+        __entry->seek = seek;
+        __entry->resets = resets;
+        __entry->arg = arg;
+    ),
+
+    TP_printk("minor %d type %d value %d seek %d resets %d arg %lu",
+              __entry->minor, __entry->type, __entry->value, __entry->seek, __entry->resets, __entry->arg)
+);
+
+#define PUBSUB_EVENT(name) \
+    DEFINE_EVENT(pubsub_class, name, \
+        TP_PROTO(int minor, int type, int value, int seek, int resets, unsigned long arg), \
+        TP_ARGS(minor, type, value, seek, resets, arg))
+
+PUBSUB_EVENT(pubsub_open);
+PUBSUB_EVENT(pubsub_release);
+PUBSUB_EVENT(pubsub_read);
+PUBSUB_EVENT(pubsub_write);
+PUBSUB_EVENT(pubsub_ioctl);
+PUBSUB_EVENT(pubsub_reset);
+PUBSUB_EVENT(pubsub_eagain);
+
+#endif
+
+// the header sits next to pubsub.c, see CFLAGS_pubsub.o in Kbuild
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE pubsub_trace
+#include <trace/define_trace.h>
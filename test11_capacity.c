@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+
+#define DEVICE_PATH "/dev/pubsub"
+#define PROC_PATH "/proc/pubsub"
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// parse the "budget <n> used <n>" line of /proc/pubsub
+void read_usage(int *budget, int *used) {
+    FILE *f = fopen(PROC_PATH, "r");
+    assert_test(f != NULL, "Open " PROC_PATH);
+    assert_test(fscanf(f, "budget %d used %d", budget, used) == 2, "Parse budget line");
+    fclose(f);
+}
+
+// a multi-page buffer: data crossing page chunk boundaries must come back intact
+void test_large_buffer() {
+    int size = 1024 * 1024 + 100; // not a multiple of any chunk order
+    char *out = malloc(size);
+    char *in = malloc(size);
+    int i, got, ret;
+
+    int pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    int sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+    assert_test(ioctl(pub_fd, SET_CAPACITY, size) == 0, "Capacity set to 1 MiB + 100");
+
+    for (i = 0; i < size; i++) {
+        out[i] = (char) (i * 7 + i / 4096);
+    }
+    assert_test(write(pub_fd, out, 5000) == 5000, "Write across the first page boundary");
+    assert_test(write(pub_fd, out + 5000, size - 5000) == size - 5000, "Fill the rest of the buffer");
+
+    for (got = 0; got < size; got += ret) {
+        ret = read(sub_fd, in + got, 3001);
+        assert_test(ret > 0, "Read a slice of the large buffer");
+    }
+    assert_test(memcmp(in, out, size) == 0, "Large buffer content matches");
+
+    close(sub_fd);
+    close(pub_fd);
+    free(in);
+    free(out);
+}
+
+int main() {
+    char buf[2 * BUFFER_SIZE];
+    int budget, used_before, used_after;
+    int ret;
+
+    printf("\nRunning PubSub capacity and memory budget tests\n");
+    printf("===============================================\n\n");
+
+    int pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    int sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+
+    read_usage(&budget, &used_before);
+    ret = ioctl(pub_fd, SET_CAPACITY, 2 * BUFFER_SIZE);
+    if (budget > 0 && used_before + BUFFER_SIZE > budget) {
+        assert_test(ret == -1 && errno == ENOMEM, "Capacity change over budget returns ENOMEM");
+        close(sub_fd);
+        close(pub_fd);
+        return 0;
+    }
+    assert_test(ret == 0, "Capacity doubled");
+    read_usage(&budget, &used_after);
+    assert_test(used_after == used_before + BUFFER_SIZE, "Usage charged for the bigger buffer");
+
+    memset(buf, 'B', sizeof(buf));
+    assert_test(write(pub_fd, buf, 1500) == 1500, "Write more than the default size");
+    ret = ioctl(pub_fd, SET_CAPACITY, BUFFER_SIZE);
+    assert_test(ret == -1 && errno == EBUSY, "Capacity cannot change while holding data");
+    ret = write(pub_fd, buf, 501);
+    assert_test(ret == -1 && errno == EAGAIN, "Write past the new capacity returns EAGAIN");
+    assert_test(read(sub_fd, buf, sizeof(buf)) == 1500, "Subscriber reads 1500 bytes");
+
+    ret = ioctl(pub_fd, SET_CAPACITY, 0);
+    assert_test(ret == -1 && errno == EINVAL, "Zero capacity returns EINVAL");
+
+    close(sub_fd);
+    close(pub_fd);
+
+    read_usage(&budget, &used_after);
+    assert_test(used_after == used_before - BUFFER_SIZE, "Closing the minor releases its buffer");
+
+    if (budget == 0 || budget - used_after > 2 * 1024 * 1024) {
+        test_large_buffer();
+    }
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
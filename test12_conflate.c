@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+
+#define DEVICE_PATH "/dev/pubsub"
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    struct pubsub_frame frame;
+    int i, ret;
+
+    printf("\nRunning PubSub last-value cache tests\n");
+    printf("=====================================\n\n");
+
+    int pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    assert_test(ioctl(pub_fd, SET_CONFLATE, 4) == 0, "Minor becomes a 4 key last-value cache");
+    int sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+    assert_test(ioctl(sub_fd, SET_READ_FRAMED, 1) == 0, "Subscriber asks for headers");
+
+    ret = write(pub_fd, buf, BUFFER_SIZE / 4);
+    assert_test(ret == -1 && errno == EINVAL, "Value larger than its slot returns EINVAL");
+
+    // the publisher never blocks, however far behind the subscriber is
+    assert_test(ioctl(pub_fd, SET_KEY, 1) == 0, "Publish under key 1");
+    for (i = 0; i < 10000; i++) {
+        sprintf(buf, "price %05d", i);
+        assert_test(write(pub_fd, buf, 11) == 11, "Write a value for key 1");
+    }
+    assert_test(ioctl(pub_fd, SET_KEY, 2) == 0, "Publish under key 2");
+    assert_test(write(pub_fd, "other", 5) == 5, "Write a value for key 2");
+
+    // the subscriber only gets the latest value of every key, oldest update first
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 2 * sizeof(frame) + 11 + 5, "Subscriber gets one value per key");
+    memcpy(&frame, buf, sizeof(frame));
+    assert_test(frame.key == 1 && frame.len == 11, "First value is key 1");
+    assert_test(memcmp(buf + sizeof(frame), "price 09999", 11) == 0, "Key 1 holds its latest value");
+    memcpy(&frame, buf + sizeof(frame) + 11, sizeof(frame));
+    assert_test(frame.key == 2 && memcmp(buf + 2 * sizeof(frame) + 11, "other", 5) == 0, "Then key 2");
+
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == -1 && errno == EAGAIN, "Nothing new to read");
+
+    assert_test(write(pub_fd, "again", 5) == 5, "Key 2 updated");
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == sizeof(frame) + 5 && memcmp(buf + sizeof(frame), "again", 5) == 0, "Only the fresh value is read");
+
+    close(sub_fd);
+    close(pub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+// a minor of its own: what it leaves behind does not hold back other tests
+#define MINOR 52
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int open_durable(const char *name) {
+    char group[GROUP_NAME_LEN];
+    int fd = open_minor(MINOR);
+    assert_test(fd >= 0, "Open durable subscriber");
+    assert_test(ioctl(fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+    memset(group, 0, sizeof(group));
+    strncpy(group, name, GROUP_NAME_LEN - 1);
+    assert_test(ioctl(fd, JOIN_DURABLE, group) == 0, "Join durable subscription");
+    return fd;
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    int ret;
+
+    printf("\nRunning PubSub durable subscription tests\n");
+    printf("=========================================\n\n");
+
+    int pub_fd = open_minor(MINOR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    int sub_fd = open_durable("billing");
+
+    ret = ioctl(pub_fd, JOIN_DURABLE, "billing");
+    assert_test(ret == -1 && errno == EPERM, "Publisher cannot join a subscription");
+
+    assert_test(write(pub_fd, "0123456789", 10) == 10, "Publish 10 bytes");
+    assert_test(read(sub_fd, buf, 4) == 4 && memcmp(buf, "0123", 4) == 0, "Read the first 4 bytes");
+
+    // the subscriber restarts: its cursor stays in the minor
+    close(sub_fd);
+    assert_test(write(pub_fd, "abc", 3) == 3, "Publish while the subscriber is gone");
+    sub_fd = open_durable("billing");
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 9 && memcmp(buf, "456789abc", 9) == 0, "Resumed exactly where it stopped");
+
+    // the cursor also survives the minor being closed by everybody
+    close(sub_fd);
+    assert_test(write(pub_fd, "xyz", 3) == 3, "Publish one more record");
+    close(pub_fd);
+    sub_fd = open_durable("billing");
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 3 && memcmp(buf, "xyz", 3) == 0, "Data kept while nobody had the minor open");
+
+    errno = 0;
+    int plain_fd = open_minor(MINOR);
+    assert_test(ioctl(plain_fd, LEAVE_DURABLE) == -1 && errno == EINVAL, "Only a durable member can leave");
+    close(plain_fd);
+    assert_test(ioctl(sub_fd, LEAVE_DURABLE) == 0, "Drop the subscription");
+    close(sub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
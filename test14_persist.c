@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+#define MINOR 53
+#define JOURNAL_DIR "/var/lib/pubsub" // persist_dir module parameter
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// the size of the minor's journal: the larger of its two files, which
+// alternate by generation
+static long journal_size(void) {
+    char path[64];
+    struct stat st;
+    long size = -1;
+    int p;
+
+    for (p = 0; p < 2; p++) {
+        sprintf(path, JOURNAL_DIR "/pubsub%d.%d.seg", MINOR, p);
+        if (stat(path, &st) == 0 && st.st_size > size) {
+            size = st.st_size;
+        }
+    }
+    return size;
+}
+
+// Run with "reload", then again after "rmmod pubsub; insmod ./pubsub.o": the
+// second run finds the record of the first one restored from the journal.
+// Without "reload" the minor is no longer persistent when the test ends.
+int main(int argc, char *argv[]) {
+    int reload = argc > 1 && strcmp(argv[1], "reload") == 0;
+    char buf[BUFFER_SIZE];
+    long size;
+    int ret;
+    int i;
+
+    printf("\nRunning PubSub persistence tests\n");
+    printf("================================\n\n");
+
+    int sub_fd = open_minor(MINOR);
+    assert_test(sub_fd >= 0, "Open a private minor");
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    if (ret > 0) {
+        assert_test(ret >= 7 && memcmp(buf, "durable", 7) == 0, "Record of the previous run restored");
+    }
+    close(sub_fd);
+
+    int pub_fd = open_minor(MINOR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    assert_test(ioctl(pub_fd, SET_PERSIST, 1) == 0, "Minor becomes persistent");
+    size = journal_size();
+    assert_test(size >= 4096, "Journal file starts with a snapshot");
+    assert_test(write(pub_fd, "durable", 7) == 7, "Publish a record");
+    // the journal is written behind the publish: a segment header page and
+    // the page the record is padded to
+    for (i = 0; i < 100 && journal_size() < size + 2 * 4096; i++) {
+        usleep(10000);
+    }
+    assert_test(journal_size() >= size + 2 * 4096, "Record appended to the journal");
+
+    // nobody has the minor open now, yet its data stays
+    close(pub_fd);
+    sub_fd = open_minor(MINOR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret >= 7 && memcmp(buf, "durable", 7) == 0, "Data kept after the last close");
+
+    if (reload) {
+        printf("\nNow \"rmmod pubsub; insmod ./pubsub.o\" and run again\n");
+    } else {
+        // the minor goes back to an ordinary one, empty once closed
+        assert_test(ioctl(sub_fd, SET_PERSIST, 0) == 0, "Minor no longer persistent");
+    }
+    close(sub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
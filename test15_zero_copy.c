@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+
+#define DEVICE_PATH "/dev/pubsub"
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main() {
+    static char big[3 * 4096];
+    char buf[sizeof(big) + 100];
+    struct pubsub_frame frame;
+    struct pubsub_zc zc;
+    int ret, i;
+
+    printf("\nRunning PubSub zero-copy publish tests\n");
+    printf("======================================\n\n");
+
+    int pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    zc.buf = "hello";
+    zc.len = 5;
+    ret = ioctl(pub_fd, PUBLISH_ZC, &zc);
+    assert_test(ret == -1 && errno == EINVAL, "Zero-copy publish needs a framed minor");
+
+    assert_test(ioctl(pub_fd, SET_FRAMED, 1) == 0, "Minor keeps record boundaries");
+    int sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+    assert_test(ioctl(sub_fd, SET_READ_FRAMED, 1) == 0, "Subscriber asks for headers");
+
+    // a record larger than the lane itself: only a reference to it is stored
+    for (i = 0; i < sizeof(big); i++) {
+        big[i] = 'a' + i % 26;
+    }
+    zc.buf = big + 100;
+    zc.len = sizeof(big) - 200;
+    assert_test(ioctl(pub_fd, PUBLISH_ZC, &zc) == 0, "Publish a record larger than the lane");
+    assert_test(write(pub_fd, "copied", 6) == 6, "Mix it with a copied record");
+    assert_test(ioctl(pub_fd, GET_ZC_DONE) == 0, "Record stays pinned while unread");
+
+    ret = read(sub_fd, buf, 100);
+    assert_test(ret == -1 && errno == EINVAL, "Pinned record is not split either");
+    ret = read(sub_fd, buf, sizeof(buf));
+    assert_test(ret == 2 * sizeof(frame) + zc.len + 6, "Subscriber reads both records");
+    memcpy(&frame, buf, sizeof(frame));
+    assert_test(frame.len == zc.len && frame.seq == 0, "Header carries the real payload length");
+    assert_test(memcmp(buf + sizeof(frame), big + 100, zc.len) == 0, "Payload comes from the publisher's pages");
+    assert_test(memcmp(buf + 2 * sizeof(frame) + zc.len, "copied", 6) == 0, "Copied record follows");
+
+    // the last subscriber read everything, so the lane reset and unpinned it
+    assert_test(ioctl(pub_fd, GET_ZC_DONE) == 1, "Publisher sees the record released");
+    assert_test(ioctl(sub_fd, GET_ZC_DONE) == -1 && errno == EPERM, "Only publishers publish zero-copy");
+
+    zc.buf = NULL;
+    zc.len = 10;
+    ret = ioctl(pub_fd, PUBLISH_ZC, &zc);
+    assert_test(ret == -1 && errno == EFAULT, "Unmapped buffer returns EFAULT");
+
+    close(sub_fd);
+    close(pub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+
+#define DEVICE_PATH "/dev/pubsub"
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    struct pollfd pfd;
+    int ret, status;
+    pid_t pid;
+
+    printf("\nRunning PubSub poll and blocking read tests\n");
+    printf("===========================================\n\n");
+
+    int pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    int sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+
+    pfd.fd = sub_fd;
+    pfd.events = POLLIN;
+    assert_test(poll(&pfd, 1, 0) == 0, "Empty minor is not readable");
+    pfd.fd = pub_fd;
+    pfd.events = POLLOUT;
+    assert_test(poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLOUT), "Empty minor is writable");
+
+    assert_test(write(pub_fd, "hello", 5) == 5, "Publish a message");
+    pfd.fd = sub_fd;
+    pfd.events = POLLIN;
+    assert_test(poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN), "Subscriber becomes readable");
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 5, "Read the message");
+    assert_test(poll(&pfd, 1, 0) == 0, "Nothing left to read");
+
+    // without SET_BLOCKING an empty read still returns EAGAIN
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == -1 && errno == EAGAIN, "Default reads do not block");
+
+    assert_test(ioctl(sub_fd, SET_BLOCKING, 1) == 0, "Subscriber asks for blocking reads");
+    pid = fork();
+    if (pid == 0) {
+        ret = read(sub_fd, buf, BUFFER_SIZE);
+        exit(ret == 5 && memcmp(buf, "world", 5) == 0 ? 0 : 1);
+    }
+    sleep(1);
+    assert_test(write(pub_fd, "world", 5) == 5, "Publish while the subscriber sleeps");
+    assert_test(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                "Blocked subscriber woke up with the message");
+
+    int nb_fd = open(DEVICE_PATH, O_RDWR | O_NONBLOCK);
+    assert_test(ioctl(nb_fd, SET_TYPE, TYPE_SUB) == 0, "Set non-blocking subscriber type");
+    assert_test(ioctl(nb_fd, SET_BLOCKING, 1) == 0, "It asks for blocking reads too");
+    assert_test(write(pub_fd, "again", 5) == 5, "Publish once more");
+    assert_test(read(nb_fd, buf, BUFFER_SIZE) == 5, "It reads the message");
+    ret = read(nb_fd, buf, BUFFER_SIZE);
+    assert_test(ret == -1 && errno == EAGAIN, "O_NONBLOCK wins over SET_BLOCKING");
+
+    close(nb_fd);
+    close(sub_fd);
+    close(pub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
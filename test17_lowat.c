@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+
+#define DEVICE_PATH "/dev/pubsub"
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static long elapsed_ms(struct timeval *start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    struct pollfd pfd;
+    struct timeval start;
+    int i;
+
+    printf("\nRunning PubSub read watermark tests\n");
+    printf("===================================\n\n");
+
+    int pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    int sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+    assert_test(ioctl(sub_fd, SET_LOWAT, 100) == 0, "Wake the subscriber at 100 bytes");
+
+    pfd.fd = sub_fd;
+    pfd.events = POLLIN;
+    assert_test(write(pub_fd, buf, 10) == 10, "Publish 10 bytes");
+    assert_test(poll(&pfd, 1, 0) == 0, "Below the watermark the subscriber is not readable");
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 10, "A non-blocking read still gets the bytes");
+    for (i = 0; i < 9; i++) {
+        assert_test(write(pub_fd, buf, 10) == 10, "Publish 10 more bytes");
+    }
+    assert_test(poll(&pfd, 1, 0) == 0, "90 bytes are still below the watermark");
+    assert_test(write(pub_fd, buf, 10) == 10, "Publish the 100th byte");
+    assert_test(poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN), "Watermark reached");
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 100, "One read takes the batch");
+
+    // max delay: a lone message is handed out after at most 200ms
+    assert_test(ioctl(sub_fd, SET_MAX_DELAY, 200) == 0, "Wait at most 200ms below the watermark");
+    assert_test(write(pub_fd, buf, 10) == 10, "Publish a lone message");
+    gettimeofday(&start, NULL);
+    assert_test(poll(&pfd, 1, 2000) == 1 && (pfd.revents & POLLIN), "Subscriber woken by the delay");
+    assert_test(elapsed_ms(&start) >= 150 && elapsed_ms(&start) < 1500, "Woken after about max_delay");
+    assert_test(ioctl(sub_fd, SET_BLOCKING, 1) == 0, "Switch to blocking reads");
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 10, "Blocking read returns at once when ready");
+
+    close(sub_fd);
+    close(pub_fd);
+
+    // record watermark on a framed minor
+    pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    assert_test(ioctl(pub_fd, SET_FRAMED, 1) == 0, "Framed minor");
+    sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+    assert_test(ioctl(sub_fd, SET_LOWAT_RECORDS, 3) == 0, "Wake the subscriber at 3 records");
+    pfd.fd = sub_fd;
+    assert_test(write(pub_fd, "a", 1) == 1 && write(pub_fd, "b", 1) == 1, "Publish 2 records");
+    assert_test(poll(&pfd, 1, 0) == 0, "2 records are below the watermark");
+    assert_test(write(pub_fd, "c", 1) == 1, "Publish the third record");
+    assert_test(poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN), "Record watermark reached");
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 3, "All three payloads read together");
+
+    close(sub_fd);
+    close(pub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    struct pubsub_multi multi;
+    int sub_fd[3];
+    int i, ret;
+
+    printf("\nRunning PubSub multi-topic publish tests\n");
+    printf("========================================\n\n");
+
+    int pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set publisher type");
+    for (i = 0; i < 3; i++) {
+        sub_fd[i] = open_minor(i + 1);
+        assert_test(sub_fd[i] >= 0, "Open a target minor");
+        assert_test(ioctl(sub_fd[i], SET_TYPE, TYPE_SUB) == 0, "Subscribe to it");
+    }
+
+    memset(&multi, 0, sizeof(multi));
+    multi.buf = "fanout";
+    multi.len = 6;
+    multi.nr_targets = 3;
+    for (i = 0; i < 3; i++) {
+        multi.minors[i] = i + 1;
+    }
+    assert_test(ioctl(pub_fd, PUBLISH_MULTI, &multi) == 3, "One call publishes to three minors");
+    for (i = 0; i < 3; i++) {
+        assert_test(multi.results[i] == 6, "Every target reports the bytes published");
+        assert_test(read(sub_fd[i], buf, BUFFER_SIZE) == 6 && memcmp(buf, "fanout", 6) == 0,
+                    "Every subscriber reads the payload");
+    }
+
+    // fill minor 2 so it has no room left
+    int fill_fd = open_minor(2);
+    assert_test(ioctl(fill_fd, SET_TYPE, TYPE_PUB) == 0, "Second publisher on minor 2");
+    assert_test(write(fill_fd, buf, BUFFER_SIZE - 2) == BUFFER_SIZE - 2, "Minor 2 is almost full");
+
+    multi.flags = PUBSUB_ALL_OR_NOTHING;
+    ret = ioctl(pub_fd, PUBLISH_MULTI, &multi);
+    assert_test(ret == -1 && errno == EAGAIN, "All-or-nothing fails when one target is full");
+    assert_test(multi.results[1] == -EAGAIN && multi.results[0] == 0 && multi.results[2] == 0,
+                "Only the full target reports an error");
+    ret = read(sub_fd[0], buf, BUFFER_SIZE);
+    assert_test(ret == -1 && errno == EAGAIN, "Nothing was published to the other targets");
+
+    multi.flags = 0;
+    assert_test(ioctl(pub_fd, PUBLISH_MULTI, &multi) == 2, "Best effort publishes where there is room");
+    assert_test(multi.results[0] == 6 && multi.results[1] == -EAGAIN && multi.results[2] == 6,
+                "Results are per target");
+
+    multi.minors[2] = 200;
+    ret = ioctl(pub_fd, PUBLISH_MULTI, &multi);
+    assert_test(ret == 1 && multi.results[2] == -ENXIO, "A minor nobody has open is skipped");
+    multi.minors[2] = 1;
+    ret = ioctl(pub_fd, PUBLISH_MULTI, &multi);
+    assert_test(ret == -1 && errno == EINVAL, "Duplicate targets are rejected");
+
+    close(fill_fd);
+    for (i = 0; i < 3; i++) {
+        close(sub_fd[i]);
+    }
+    close(pub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
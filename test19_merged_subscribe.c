@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// the next record of a merged read: its minor, payload length and payload
+char *next_record(char *p, int *minor, int *len, char **payload) {
+    struct pubsub_merged hdr;
+
+    memcpy(&hdr, p, sizeof(hdr));
+    *minor = hdr.minor;
+    *len = hdr.frame.len;
+    *payload = p + sizeof(hdr);
+    return *payload + hdr.frame.len;
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    struct pubsub_merge merge;
+    char *p, *payload;
+    int minor, len;
+    int pub_fd[4];
+    int i, ret;
+
+    printf("\nRunning PubSub merged subscription tests\n");
+    printf("========================================\n\n");
+
+    // minors 4 and 5 stay raw, 6 and 7 are framed
+    for (i = 0; i < 4; i++) {
+        pub_fd[i] = open_minor(i + 4);
+        assert_test(pub_fd[i] >= 0, "Open a minor to merge");
+        assert_test(ioctl(pub_fd[i], SET_TYPE, TYPE_PUB) == 0, "Publisher on it");
+        if (i >= 2) {
+            assert_test(ioctl(pub_fd[i], SET_FRAMED, 1) == 0, "Framed minor");
+        }
+    }
+
+    int merged_fd = open(DEVICE_PATH, O_RDWR);
+    memset(&merge, 0, sizeof(merge));
+    merge.order = PUBSUB_MERGE_FAIR;
+    merge.nr_minors = 2;
+    merge.minors[0] = 4;
+    merge.minors[1] = 4;
+    errno = 0;
+    assert_test(ioctl(merged_fd, SUBSCRIBE_MULTI, &merge) == -1 && errno == EINVAL, "A minor is merged only once");
+    merge.minors[1] = 5;
+    assert_test(ioctl(merged_fd, SUBSCRIBE_MULTI, &merge) == 0, "Merge minors 4 and 5");
+    assert_test(ioctl(merged_fd, GET_TYPE) == TYPE_MERGED, "File is a merged reader");
+    errno = 0;
+    assert_test(ioctl(merged_fd, SET_TYPE, TYPE_SUB) == -1 && errno == EPERM, "Merged file keeps its type");
+
+    errno = 0;
+    assert_test(read(merged_fd, buf, BUFFER_SIZE) == -1 && errno == EAGAIN, "Nothing to read yet");
+    assert_test(write(pub_fd[1], "five", 4) == 4, "Publish on minor 5");
+    assert_test(write(pub_fd[0], "four", 4) == 4, "Publish on minor 4");
+    ret = read(merged_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 2 * (int) sizeof(struct pubsub_merged) + 8, "One read returns both records");
+    p = next_record(buf, &minor, &len, &payload);
+    assert_test(minor == 4 && len == 4 && memcmp(payload, "four", 4) == 0, "Fair order starts with minor 4");
+    next_record(p, &minor, &len, &payload);
+    assert_test(minor == 5 && len == 4 && memcmp(payload, "five", 4) == 0, "Then minor 5");
+
+    assert_test(write(pub_fd[0], "again", 5) == 5, "Publish on minor 4 again");
+    errno = 0;
+    assert_test(read(merged_fd, buf, sizeof(struct pubsub_merged) + 2) == -1 && errno == EINVAL,
+                "A record is never split");
+    ret = read(merged_fd, buf, BUFFER_SIZE);
+    next_record(buf, &minor, &len, &payload);
+    assert_test(ret == (int) sizeof(struct pubsub_merged) + 5 && minor == 4 && memcmp(payload, "again", 5) == 0,
+                "The record stays for the next read");
+
+    int time_fd = open(DEVICE_PATH, O_RDWR);
+    merge.order = PUBSUB_MERGE_TIME;
+    merge.minors[0] = 6;
+    merge.minors[1] = 7;
+    assert_test(ioctl(time_fd, SUBSCRIBE_MULTI, &merge) == 0, "Merge minors 6 and 7 by publish time");
+    assert_test(write(pub_fd[3], "first", 5) == 5, "Publish on minor 7");
+    usleep(2000);
+    assert_test(write(pub_fd[2], "second", 6) == 6, "Then on minor 6");
+    usleep(2000);
+    assert_test(write(pub_fd[3], "third", 5) == 5, "Then on minor 7 again");
+    ret = read(time_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 3 * (int) sizeof(struct pubsub_merged) + 16, "One read returns the three records");
+    p = next_record(buf, &minor, &len, &payload);
+    assert_test(minor == 7 && memcmp(payload, "first", 5) == 0, "Oldest record first");
+    p = next_record(p, &minor, &len, &payload);
+    assert_test(minor == 6 && memcmp(payload, "second", 6) == 0, "Then the next oldest");
+    next_record(p, &minor, &len, &payload);
+    assert_test(minor == 7 && memcmp(payload, "third", 5) == 0, "Newest record last");
+
+    close(time_fd);
+    close(merged_fd);
+    for (i = 0; i < 4; i++) {
+        close(pub_fd[i]);
+    }
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// the reclaimed counter of a minor in /proc/pubsub, -1 if it is not listed
+long reclaimed(int minor) {
+    char line[256], prefix[32];
+    long bytes = -1;
+    char *p;
+    FILE *f = fopen("/proc/pubsub", "r");
+
+    if (f == NULL) {
+        return -1;
+    }
+    sprintf(prefix, "minor %d ", minor);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, prefix, strlen(prefix)) == 0 && (p = strstr(line, "reclaimed ")) != NULL) {
+            bytes = atol(p + strlen("reclaimed "));
+        }
+    }
+    fclose(f);
+    return bytes;
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    struct pubsub_retention retention;
+    int ret;
+
+    printf("\nRunning PubSub retention tests\n");
+    printf("==============================\n\n");
+
+    // raw minor: at most 10 bytes are kept
+    int pub_fd = open_minor(8);
+    int sub_fd = open_minor(8);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on minor 8");
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Subscriber on minor 8");
+    memset(&retention, 0, sizeof(retention));
+    retention.max_bytes = 10;
+    assert_test(ioctl(pub_fd, SET_RETENTION, &retention) == 0, "Keep at most 10 bytes");
+    assert_test(write(pub_fd, "aaaaaaaaaa", 10) == 10, "Publish 10 bytes");
+    assert_test(write(pub_fd, "bbbbbbbbbb", 10) == 10, "Publish 10 more");
+    assert_test(write(pub_fd, "cccccccccc", 10) == 10, "And 10 more");
+    usleep(100000);
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 10 && memcmp(buf, "cccccccccc", 10) == 0, "Only the newest 10 bytes are left");
+    assert_test(reclaimed(8) == 20, "The dropped bytes show in /proc/pubsub");
+
+    // framed minor: at most 2 records are kept
+    int fpub_fd = open_minor(9);
+    int fsub_fd = open_minor(9);
+    assert_test(ioctl(fpub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on minor 9");
+    assert_test(ioctl(fpub_fd, SET_FRAMED, 1) == 0, "Framed minor");
+    assert_test(ioctl(fsub_fd, SET_TYPE, TYPE_SUB) == 0, "Subscriber on minor 9");
+    memset(&retention, 0, sizeof(retention));
+    retention.max_records = 2;
+    assert_test(ioctl(fpub_fd, SET_RETENTION, &retention) == 0, "Keep at most 2 records");
+    assert_test(write(fpub_fd, "r1", 2) == 2 && write(fpub_fd, "r2", 2) == 2 &&
+                write(fpub_fd, "r3", 2) == 2 && write(fpub_fd, "r4", 2) == 2, "Publish 4 records");
+    usleep(100000);
+    ret = read(fsub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 4 && memcmp(buf, "r3r4", 4) == 0, "Only the newest 2 records are left");
+
+    // records older than 50ms go, even with nobody reading
+    int apub_fd = open_minor(10);
+    int asub_fd = open_minor(10);
+    assert_test(ioctl(apub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on minor 10");
+    assert_test(ioctl(apub_fd, SET_FRAMED, 1) == 0, "Framed minor");
+    assert_test(ioctl(asub_fd, SET_TYPE, TYPE_SUB) == 0, "Subscriber on minor 10");
+    memset(&retention, 0, sizeof(retention));
+    retention.max_age_ms = 50;
+    assert_test(ioctl(apub_fd, SET_RETENTION, &retention) == 0, "Keep records for 50ms");
+    assert_test(write(apub_fd, "old", 3) == 3, "Publish a record");
+    usleep(300000);
+    errno = 0;
+    assert_test(read(asub_fd, buf, BUFFER_SIZE) == -1 && errno == EAGAIN, "It expired unread");
+    assert_test(write(apub_fd, buf, BUFFER_SIZE - sizeof(struct pubsub_frame)) ==
+                BUFFER_SIZE - sizeof(struct pubsub_frame), "Its room is free again");
+    ret = read(asub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == BUFFER_SIZE - (int) sizeof(struct pubsub_frame), "A fresh record is read");
+
+    // a topic nobody subscribes to does not keep its data
+    int npub_fd = open_minor(11);
+    assert_test(ioctl(npub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on minor 11");
+    memset(&retention, 0, sizeof(retention));
+    retention.max_bytes = 100;
+    assert_test(ioctl(npub_fd, SET_RETENTION, &retention) == 0, "Keep at most 100 bytes");
+    memset(buf, 'x', BUFFER_SIZE);
+    assert_test(write(npub_fd, buf, 900) == 900, "Publish 900 bytes");
+    usleep(100000);
+    assert_test(write(npub_fd, buf, 900) == 900, "The room was reclaimed for the next publish");
+
+    int conf_fd = open_minor(12);
+    assert_test(ioctl(conf_fd, SET_CONFLATE, 4) == 0, "Conflating minor");
+    errno = 0;
+    assert_test(ioctl(conf_fd, SET_RETENTION, &retention) == -1 && errno == EINVAL,
+                "Conflating minors have no retention");
+
+    close(conf_fd);
+    close(npub_fd);
+    close(asub_fd);
+    close(apub_fd);
+    close(fsub_fd);
+    close(fpub_fd);
+    close(sub_fd);
+    close(pub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
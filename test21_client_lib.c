@@ -0,0 +1,88 @@
+// Build with: gcc -o test21 test21_client_lib.c libpubsub.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+#include "libpubsub.h"
+#include "test_minor.h"
+
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    struct pubsub_frame frame;
+    const void *payload;
+    ssize_t ret;
+
+    printf("\nRunning PubSub client library tests\n");
+    printf("===================================\n\n");
+
+    // batched publishing on a raw minor
+    struct ps_client *pub = ps_open(minor_path(13), TYPE_PUB);
+    struct ps_client *sub = ps_open(minor_path(13), TYPE_SUB);
+    assert_test(pub != NULL && sub != NULL, "Open a publisher and a subscriber");
+    assert_test(ps_set_batch(pub, 16, 1000) == 0, "Batch up to 16 bytes for a second");
+    assert_test(ps_publish(pub, "ab", 2) == 0 && ps_publish(pub, "cd", 2) == 0, "Two small publishes");
+    errno = 0;
+    assert_test(ps_read(sub, buf, BUFFER_SIZE) == -1 && errno == EAGAIN, "They are still batched");
+    assert_test(ps_flush_timeout(pub) > 0, "The batch has a deadline");
+    assert_test(ps_flush(pub) == 0, "Flush the batch");
+    ret = ps_read(sub, buf, BUFFER_SIZE);
+    assert_test(ret == 4 && memcmp(buf, "abcd", 4) == 0, "One write carried both publishes");
+    assert_test(ps_flush_timeout(pub) == -1, "Nothing is batched any more");
+
+    assert_test(ps_publish(pub, "0123456789", 10) == 0, "Publish 10 bytes");
+    assert_test(ps_publish(pub, "abcdefghij", 10) == 0, "The next 10 do not fit in the batch");
+    ret = ps_read(sub, buf, BUFFER_SIZE);
+    assert_test(ret == 10 && memcmp(buf, "0123456789", 10) == 0, "So the full batch went out first");
+
+    assert_test(ps_set_batch(pub, 16, 20) == 0, "Flush deadline of 20ms");
+    ret = ps_read(sub, buf, BUFFER_SIZE);
+    assert_test(ret == 10 && memcmp(buf, "abcdefghij", 10) == 0, "Changing the batch flushes it");
+    assert_test(ps_publish(pub, "x", 1) == 0, "Publish a byte");
+    usleep(50000);
+    assert_test(ps_flush_expired(pub) == 0, "The deadline passed");
+    assert_test(ps_read(sub, buf, BUFFER_SIZE) == 1 && buf[0] == 'x', "So it was flushed");
+    errno = 0;
+    assert_test(ps_set_framed(pub, 1) == -1 && errno == EINVAL, "Framed minors do not batch");
+
+    // record reads on a framed minor
+    struct ps_client *fpub = ps_open(minor_path(14), TYPE_PUB);
+    struct ps_client *fsub = ps_open(minor_path(14), TYPE_SUB);
+    assert_test(fpub != NULL && fsub != NULL, "Open a framed minor");
+    assert_test(ps_set_framed(fpub, 1) == 0, "Minor keeps record boundaries");
+    assert_test(ps_wait(fsub, 0) == 0, "Nothing to read yet");
+    assert_test(ps_publish(fpub, "one", 3) == 0 && ps_publish(fpub, "three", 5) == 0, "Publish two records");
+    assert_test(ps_wait(fsub, 0) == 1, "The subscriber is readable");
+    ret = ps_next(fsub, &frame, &payload);
+    assert_test(ret == 3 && memcmp(payload, "one", 3) == 0, "First record");
+    // the second one was read along with the first
+    assert_test(ps_wait(fsub, 0) == 1, "The second record is already here");
+    ret = ps_next(fsub, &frame, &payload);
+    assert_test(ret == 5 && memcmp(payload, "three", 5) == 0 && frame.len == 5, "Second record");
+    errno = 0;
+    assert_test(ps_next(fsub, &frame, &payload) == -1 && errno == EAGAIN, "No more records");
+
+    assert_test(ps_close(fsub) == 0 && ps_close(fpub) == 0, "Close the framed minor");
+    assert_test(ps_close(sub) == 0 && ps_close(pub) == 0, "Close the raw minor");
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+#define BUFFER_SIZE 1000
+// page backed, which 2.4 places as well: its small buffers stay at node -1
+#define CAPACITY (64 * 1024)
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// the /proc/pubsub line of a minor, or the header line for -1
+int proc_line(int minor, char *line, int size) {
+    char prefix[32];
+    int found = 0;
+    FILE *f = fopen("/proc/pubsub", "r");
+
+    if (f == NULL) {
+        return 0;
+    }
+    sprintf(prefix, "minor %d ", minor);
+    while (!found && fgets(line, size, f) != NULL) {
+        found = minor < 0 ? strncmp(line, "budget ", 7) == 0 : strncmp(line, prefix, strlen(prefix)) == 0;
+    }
+    fclose(f);
+    return found;
+}
+
+int main() {
+    char line[256];
+    char *p;
+
+    printf("\nRunning PubSub NUMA placement tests\n");
+    printf("===================================\n\n");
+
+    int sub_fd = open_minor(15);
+    assert_test(sub_fd >= 0, "Open minor 15");
+    assert_test(proc_line(15, line, sizeof(line)) && strstr(line, "node -1") != NULL,
+                "Its buffer is not placed before a publisher comes");
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Subscriber on it");
+    assert_test(ioctl(sub_fd, SET_CAPACITY, CAPACITY) == 0, "Buffers large enough to be placed");
+
+    int pub_fd = open_minor(15);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on it");
+    assert_test(proc_line(15, line, sizeof(line)) && (p = strstr(line, "node ")) != NULL && atoi(p + 5) >= 0,
+                "The publisher placed the buffer on its node");
+    assert_test(write(pub_fd, "local", 5) == 5, "Publish a message");
+
+    assert_test(ioctl(pub_fd, SET_NODE, 0) == 0, "Pin the minor to node 0");
+    assert_test(proc_line(15, line, sizeof(line)) && strstr(line, "node 0 pinned") != NULL,
+                "/proc/pubsub shows the pin");
+    char buf[BUFFER_SIZE];
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 5 && memcmp(buf, "local", 5) == 0,
+                "Data moved along with the buffer");
+    errno = 0;
+    assert_test(ioctl(pub_fd, SET_NODE, 1000) == -1 && errno == EINVAL, "Unknown nodes are refused");
+    assert_test(ioctl(pub_fd, SET_NODE, -1) == 0, "Unpin the minor");
+    assert_test(proc_line(15, line, sizeof(line)) && strstr(line, "pinned") == NULL, "The pin is gone");
+
+    assert_test(proc_line(-1, line, sizeof(line)) && (p = strstr(line, "node0 ")) != NULL && atoi(p + 6) >= 1,
+                "Buffers per node are counted");
+
+    close(pub_fd);
+    close(sub_fd);
+
+    // a last-value cache keeps its values in slots past buff_len: moving it
+    // to another node, and back, keeps every one
+    int lvc_fd = open_minor(54);
+    assert_test(lvc_fd >= 0, "Open minor 54");
+    assert_test(ioctl(lvc_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on it");
+    assert_test(ioctl(lvc_fd, SET_CAPACITY, CAPACITY) == 0, "Buffers large enough to be placed");
+    assert_test(ioctl(lvc_fd, SET_CONFLATE, 4) == 0, "Minor 54 becomes a 4 key last-value cache");
+    int lvc_sub = open_minor(54);
+    assert_test(ioctl(lvc_sub, SET_TYPE, TYPE_SUB) == 0, "Subscriber on it");
+    assert_test(ioctl(lvc_fd, SET_KEY, 1) == 0 && write(lvc_fd, "one", 3) == 3, "Value of key 1");
+    assert_test(ioctl(lvc_fd, SET_KEY, 3) == 0 && write(lvc_fd, "three", 5) == 5, "Value of key 3");
+    if (access("/sys/devices/system/node/node1", F_OK) == 0) {
+        assert_test(ioctl(lvc_fd, SET_NODE, 1) == 0, "Move the cache to node 1");
+    }
+    assert_test(ioctl(lvc_fd, SET_NODE, 0) == 0, "Move the cache to node 0");
+    int ret = read(lvc_sub, buf, BUFFER_SIZE);
+    assert_test(ret == 8 && memcmp(buf, "one", 3) == 0 && memcmp(buf + 3, "three", 5) == 0,
+                "Both values moved with the cache");
+    assert_test(ioctl(lvc_fd, SET_NODE, -1) == 0, "Unpin the cache");
+    close(lvc_sub);
+    close(lvc_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+#define PUBLISHERS 4
+#define RECORDS 200
+#define BENCH_RECORDS 20000 // per publisher of a scaling run
+#define MAX_BENCH_CPUS 8
+
+int pin_to(int cpu) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// one publisher process: RECORDS numbered records under its own key
+void publish(int id) {
+    int fd = open_minor(16);
+    int i;
+
+    if (fd < 0 || ioctl(fd, SET_TYPE, TYPE_PUB) != 0 || ioctl(fd, SET_KEY, id) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < RECORDS; i++) {
+        while (write(fd, &i, sizeof(i)) != sizeof(i)) {
+            if (errno != EAGAIN) {
+                exit(EXIT_FAILURE);
+            }
+            usleep(1000);
+        }
+    }
+    close(fd);
+    exit(EXIT_SUCCESS);
+}
+
+// a publisher of a scaling run, alone on its CPU; it gives up after a minute
+void publish_pinned(int cpu) {
+    double deadline = now_ns() + 60e9;
+    int fd = open_minor(16);
+    int i;
+
+    pin_to(cpu);
+    if (fd < 0 || ioctl(fd, SET_TYPE, TYPE_PUB) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < BENCH_RECORDS; i++) {
+        while (write(fd, &i, sizeof(i)) != sizeof(i)) {
+            if (errno != EAGAIN || now_ns() > deadline) {
+                exit(EXIT_FAILURE);
+            }
+            sched_yield();
+        }
+    }
+    close(fd);
+    exit(EXIT_SUCCESS);
+}
+
+// records per second that reach the subscriber from n publishers on n CPUs,
+// -1 when some of them did not
+double fanin_rate(int sub_fd, int n) {
+    static char buf[65536];
+    long expected = (long) n * BENCH_RECORDS;
+    long records = 0;
+    double start = now_ns();
+    double elapsed;
+    int failed = 0;
+    int i, ret, status;
+
+    for (i = 0; i < n; i++) {
+        if (fork() == 0) {
+            publish_pinned(i);
+        }
+    }
+    while (records < expected && now_ns() - start < 60e9) {
+        char *p = buf;
+
+        ret = read(sub_fd, buf, sizeof(buf));
+        if (ret < 0 && errno != EAGAIN) {
+            break;
+        }
+        while (ret > 0 && p < buf + ret) {
+            struct pubsub_frame frame;
+
+            memcpy(&frame, p, sizeof(frame));
+            p += sizeof(frame) + frame.len;
+            records ++;
+        }
+        if (ret <= 0) {
+            sched_yield();
+        }
+    }
+    elapsed = now_ns() - start;
+    for (i = 0; i < n; i++) {
+        wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+    return records == expected && !failed ? records / (elapsed / 1e9) : -1;
+}
+
+int main() {
+    static char buf[65536];
+    int next[PUBLISHERS] = {0};
+    struct pubsub_frame frame;
+    int records = 0, in_order = 1, seq_ok = 1;
+    unsigned int last_seq = 0;
+    int i, status, ret;
+
+    printf("\nRunning PubSub high fan-in tests\n");
+    printf("================================\n\n");
+
+    int sub_fd = open_minor(16);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Subscriber on minor 16");
+    assert_test(ioctl(sub_fd, SET_CAPACITY, sizeof(buf)) == 0, "Room for every record");
+    assert_test(ioctl(sub_fd, SET_FRAMED, 1) == 0, "Framed minor");
+    assert_test(ioctl(sub_fd, SET_READ_FRAMED, 1) == 0, "Read the headers");
+    assert_test(ioctl(sub_fd, SET_FANIN, 4096) == 0, "Per-CPU staging of 4KB");
+    errno = 0;
+    assert_test(ioctl(sub_fd, SET_FANIN, 8192) == -1 && errno == EBUSY, "The staging size is kept until reset");
+
+    for (i = 0; i < PUBLISHERS; i++) {
+        if (fork() == 0) {
+            publish(i);
+        }
+    }
+    for (i = 0; i < PUBLISHERS; i++) {
+        wait(&status);
+        assert_test(WIFEXITED(status) && WEXITSTATUS(status) == 0, "A publisher staged all its records");
+    }
+
+    while ((ret = read(sub_fd, buf, sizeof(buf))) > 0) {
+        char *p = buf;
+        while (p < buf + ret) {
+            int value;
+            memcpy(&frame, p, sizeof(frame));
+            memcpy(&value, p + sizeof(frame), sizeof(value));
+            if (frame.key >= PUBLISHERS || value != next[frame.key]) {
+                in_order = 0;
+            } else {
+                next[frame.key] ++;
+            }
+            if (records > 0 && frame.seq != last_seq + 1) {
+                seq_ok = 0;
+            }
+            last_seq = frame.seq;
+            records ++;
+            p += sizeof(frame) + frame.len;
+        }
+    }
+    assert_test(records == PUBLISHERS * RECORDS, "Every staged record reached the subscriber");
+    assert_test(in_order, "Each publisher's records kept their order");
+    assert_test(seq_ok, "The drain numbered the records without gaps");
+
+    // publishers on more CPUs should publish more, not wait on each other
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double one = 0;
+    int n;
+    for (n = 1; n <= cpus && n <= MAX_BENCH_CPUS; n *= 2) {
+        double rate = fanin_rate(sub_fd, n);
+
+        assert_test(rate > 0, "Every record of the scaling run arrived");
+        if (n == 1) {
+            one = rate;
+        }
+        printf("%d publisher CPU%s: %.0f records/s, %.2fx one CPU\n", n, n > 1 ? "s" : "", rate, rate / one);
+    }
+    printf("The rates above are for comparison only\n\n");
+
+    assert_test(ioctl(sub_fd, SET_FANIN, 0) == 0, "Back to direct writes");
+    int pub_fd = open_minor(16);
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on minor 16");
+    assert_test(write(pub_fd, "direct", 6) == 6, "Publish directly");
+    ret = read(sub_fd, buf, sizeof(buf));
+    assert_test(ret == (int) sizeof(frame) + 6 && memcmp(buf + sizeof(frame), "direct", 6) == 0,
+                "The subscriber reads it");
+
+    close(pub_fd);
+    close(sub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
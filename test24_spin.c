@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+#define MESSAGES 50
+
+int main() {
+    char buf[BUFFER_SIZE];
+    struct pubsub_spin_stats stats;
+    int i, status;
+
+    printf("\nRunning PubSub spin-then-sleep tests\n");
+    printf("====================================\n\n");
+
+    int sub_fd = open_minor(17);
+    int pub_fd = open_minor(17);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Subscriber on minor 17");
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on minor 17");
+    assert_test(ioctl(sub_fd, SET_BLOCKING, 1) == 0, "Blocking reads");
+    errno = 0;
+    assert_test(ioctl(sub_fd, SET_SPIN, 1000000) == -1 && errno == EINVAL, "Spins are bounded");
+    assert_test(ioctl(sub_fd, SET_SPIN, 500) == 0, "Spin up to 500us before sleeping");
+    assert_test(ioctl(sub_fd, GET_SPIN_STATS, &stats) == 0 && stats.spins == 0 && stats.sleeps == 0 &&
+                stats.budget_us == 500, "Nothing counted yet, full budget");
+
+    if (fork() == 0) {
+        for (i = 0; i < MESSAGES; i++) {
+            usleep(100);
+            if (write(pub_fd, "m", 1) != 1) {
+                exit(EXIT_FAILURE);
+            }
+        }
+        exit(EXIT_SUCCESS);
+    }
+    for (i = 0; i < MESSAGES; ) {
+        int ret = read(sub_fd, buf, BUFFER_SIZE);
+        assert_test(ret > 0, "A blocking read returns messages");
+        i += ret;
+    }
+    wait(&status);
+    assert_test(WIFEXITED(status) && WEXITSTATUS(status) == 0, "The publisher sent every message");
+
+    assert_test(ioctl(sub_fd, GET_SPIN_STATS, &stats) == 0, "Read the spin stats");
+    printf("spins %u sleeps %u budget %uus gap %uus\n", stats.spins, stats.sleeps, stats.budget_us,
+           stats.avg_gap_us);
+    assert_test(stats.spins + stats.sleeps > 0 && stats.spins + stats.sleeps <= MESSAGES,
+                "Every read that waited either spun or slept");
+    assert_test(stats.budget_us <= 500, "The budget stays within SET_SPIN");
+    assert_test(stats.avg_gap_us > 0, "Gaps between messages were measured");
+
+    // records far apart make spinning pointless
+    assert_test(ioctl(sub_fd, SET_SPIN, 50) == 0, "Spin up to 50us");
+    for (i = 0; i < 3; i++) {
+        if (fork() == 0) {
+            usleep(20000);
+            exit(write(pub_fd, "s", 1) == 1 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        assert_test(read(sub_fd, buf, BUFFER_SIZE) == 1, "A slow message arrives");
+        wait(&status);
+    }
+    assert_test(ioctl(sub_fd, GET_SPIN_STATS, &stats) == 0 && stats.budget_us == 0,
+                "The budget drops to nothing when messages are 20ms apart");
+
+    close(pub_fd);
+    close(sub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+// 2.4 keeps the events SET_TRACE selects in a ring in /proc, current kernels
+// have a tracepoint per event, enabled in tracefs
+#define TRACE_PATH "/proc/pubsub_trace"
+#define TRACEFS "/sys/kernel/tracing/"
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+const char *trace_path = TRACE_PATH;
+int ring = 1;
+
+// the TRACE_x events by number
+const char *event_names[NR_TRACE_EVENTS] = { "open", "release", "read", "write", "ioctl", "reset", "eagain" };
+
+int write_file(const char *path, const char *text) {
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    int ok = fd >= 0 && write(fd, text, strlen(text)) == strlen(text);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+// where the events go; on current kernels the trace buffer is emptied
+int trace_setup() {
+    if (access(TRACE_PATH, R_OK) == 0) {
+        return 1;
+    }
+    ring = 0;
+    trace_path = TRACEFS "trace";
+    return write_file(trace_path, "");
+}
+
+// record the events of mask: SET_TRACE for the ring, each tracepoint's own
+// switch in tracefs
+int trace_events(int fd, int mask) {
+    char path[128];
+    int i;
+
+    if (ring) {
+        return ioctl(fd, SET_TRACE, mask) == 0;
+    }
+    for (i = 0; i < NR_TRACE_EVENTS; i++) {
+        sprintf(path, TRACEFS "events/pubsub/pubsub_%s/enable", event_names[i]);
+        if (!write_file(path, mask & (1 << i) ? "1" : "0")) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// number of lines of the trace of this event on minor 18, with value if >= 0
+int count_events(const char *event, int value) {
+    char line[512];
+    char name[16];
+    int minor, type, v;
+    int count = 0;
+    FILE *f = fopen(trace_path, "r");
+
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        // a ring line starts with its jiffies, a tracefs one with the task and time
+        char *fields = strstr(line, " pubsub_");
+        int n = fields != NULL ? sscanf(fields, " pubsub_%15[a-z]: minor %d type %d value %d", name, &minor, &type, &v)
+                               : sscanf(line, "%*u %15s minor %d type %d value %d", name, &minor, &type, &v);
+
+        if (n == 4 && strcmp(name, event) == 0 && minor == 18 && (value < 0 || v == value)) {
+            count++;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+
+    printf("\nRunning PubSub tracing tests\n");
+    printf("============================\n\n");
+
+    assert_test(trace_setup(), "Find the trace (run as root)");
+    int pub_fd = open_minor(18);
+    assert_test(pub_fd >= 0, "Open minor 18");
+    errno = 0;
+    if (ring) {
+        assert_test(ioctl(pub_fd, SET_TRACE, 1 << NR_TRACE_EVENTS) == -1 && errno == EINVAL,
+                    "Unknown events are refused");
+    } else {
+        assert_test(ioctl(pub_fd, SET_TRACE, 1) == -1 && errno == EOPNOTSUPP, "tracefs enables the events");
+    }
+    assert_test(trace_events(pub_fd, 0), "Tracing off");
+    int sub_fd = open_minor(18);
+    assert_test(sub_fd >= 0 && ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Subscriber on minor 18");
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on minor 18");
+    assert_test(write(pub_fd, "untraced", 8) == 8, "Write while tracing is off");
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 8, "Read while tracing is off");
+    assert_test(count_events("write", 8) == 0 && count_events("read", 8) == 0,
+                "Nothing is recorded while tracing is off");
+
+    assert_test(trace_events(pub_fd, (1 << NR_TRACE_EVENTS) - 1), "Trace every event");
+    int other_fd = open_minor(18);
+    assert_test(other_fd >= 0 && count_events("open", -1) >= 1, "The open is traced");
+    assert_test(ioctl(other_fd, SET_TYPE, TYPE_PUB) == 0 && count_events("ioctl", _IOC_NR(SET_TYPE)) >= 1,
+                "The ioctl is traced with its number");
+    errno = 0;
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == -1 && errno == EAGAIN, "Nothing to read yet");
+    assert_test(count_events("eagain", TRACE_NO_DATA) >= 1, "The EAGAIN is traced with its cause");
+    assert_test(write(pub_fd, "traced!", 7) == 7 && count_events("write", 7) >= 1, "The write is traced");
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 7 && count_events("read", 7) >= 1, "The read is traced");
+    assert_test(count_events("reset", -1) >= 1, "The lane read by everyone was reset");
+    close(other_fd);
+    assert_test(count_events("release", -1) >= 1, "The release is traced");
+
+    assert_test(trace_events(pub_fd, 1 << TRACE_WRITE), "Trace writes only");
+    int before = count_events("ioctl", -1);
+    assert_test(ioctl(pub_fd, SET_PRIORITY, 0) == 0 && count_events("ioctl", -1) == before,
+                "Events out of the mask are not recorded");
+    assert_test(trace_events(pub_fd, 0), "Tracing off again");
+    close(sub_fd);
+    close(pub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
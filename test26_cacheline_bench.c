@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+#define BUFFER_SIZE 4096
+#define CAPACITY (64 * 1024)
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int pin_to(int cpu) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// publish the numbers from..to-1, retrying while the lane is full
+void publish(int pub_fd, unsigned int from, unsigned int to) {
+    unsigned int n;
+
+    for (n = from; n < to; ) {
+        if (write(pub_fd, &n, sizeof(n)) == sizeof(n)) {
+            n++;
+        } else if (errno != EAGAIN) {
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// read until the number `to` would be next; 0 when the numbers came in order
+int consume(int sub_fd, unsigned int *next, unsigned int to) {
+    unsigned int buf[BUFFER_SIZE / sizeof(unsigned int)];
+    int i;
+
+    while (*next < to) {
+        int ret = read(sub_fd, buf, sizeof(buf));
+        if (ret < 0 && errno == EAGAIN) {
+            continue;
+        }
+        if (ret <= 0 || ret % sizeof(unsigned int) != 0) {
+            return -1;
+        }
+        for (i = 0; i < ret / (int) sizeof(unsigned int); i++) {
+            if (buf[i] != (*next)++) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Publisher and subscriber on one CPU, taking turns: no cache line of the
+// minor ever leaves that CPU. ns per record.
+double run_same_cpu(int pub_fd, int sub_fd, unsigned int records) {
+    unsigned int next = 0;
+    unsigned int n;
+    double start;
+
+    pin_to(0);
+    start = now_ns();
+    for (n = 0; n < records; n += 64) {
+        unsigned int to = n + 64 < records ? n + 64 : records;
+        publish(pub_fd, n, to);
+        if (consume(sub_fd, &next, to)) {
+            printf("out of order at %u\n", next);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return (now_ns() - start) / records;
+}
+
+// Publisher on cpu 1 and subscriber on cpu 0 at the same time: every line
+// both sides write moves between the CPUs. ns per record; compare the ratio
+// to the same-cpu cost across module builds to see lines stop bouncing.
+double run_cross_cpu(int pub_fd, int sub_fd, unsigned int records) {
+    unsigned int next = 0;
+    double start;
+    int status;
+
+    start = now_ns();
+    if (fork() == 0) {
+        pin_to(1);
+        publish(pub_fd, 0, records);
+        exit(EXIT_SUCCESS);
+    }
+    pin_to(0);
+    if (consume(sub_fd, &next, records)) {
+        printf("out of order at %u\n", next);
+        exit(EXIT_FAILURE);
+    }
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    return (now_ns() - start) / records;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int records = argc > 1 ? atoi(argv[1]) : 200000;
+    double same, cross;
+
+    printf("\nRunning PubSub cross-core microbenchmark\n");
+    printf("========================================\n\n");
+
+    int pub_fd = open_minor(19);
+    int sub_fd = open_minor(19);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Subscriber on minor 19");
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Publisher on minor 19");
+    assert_test(ioctl(pub_fd, SET_CAPACITY, CAPACITY) == 0, "64KB lanes");
+
+    same = run_same_cpu(pub_fd, sub_fd, records);
+    printf("same cpu:  %.1f ns/record\n", same);
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        printf("one CPU online, no cross-core run\n");
+    } else {
+        cross = run_cross_cpu(pub_fd, sub_fd, records);
+        printf("cross cpu: %.1f ns/record, %.2fx the same-cpu cost\n", cross, cross / same);
+    }
+
+    close(pub_fd);
+    close(sub_fd);
+
+    // a measurement, not a check: compare the ratio between module builds
+    printf("\nEvery record arrived in order; the timings above are for comparison only\n");
+    return 0;
+}
@@ -0,0 +1,318 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "pubsub.h"
+#include "test_minor.h"
+
+// Stress harness: forks publishers and subscribers across several minors,
+// runs them for a while, and checks every record each subscriber got
+// against a model of what its minor's publishers sent. The whole run is
+// repeated on 1, 2, 4... CPUs to report how throughput scales.
+//
+// usage: test27_stress [-m minors] [-p publishers per minor]
+//                      [-s subscribers per minor] [-d seconds per run] [-c max cpus]
+
+#define FIRST_MINOR 20
+#define MAX_MINORS 32
+#define MAX_PUBS 16
+#define CAPACITY (64 * 1024)
+#define MAX_BODY 61
+#define READ_SIZE 8192
+#define DRAIN_TIMEOUT 10 // seconds subscribers wait for records after the publishers stopped
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// what the processes of a run share
+struct shared {
+    volatile int ready; // subscribers that set up their file
+    volatile int stop; // publishers stop publishing
+    volatile int done; // publishers that stopped
+    volatile int failed; // a process gave up: nobody waits for the others any more
+    volatile unsigned int published[MAX_MINORS][MAX_PUBS];
+    volatile unsigned long received; // records checked by all subscribers together
+};
+
+int nr_minors = 4;
+int nr_pubs = 2;
+int nr_subs = 2;
+int seconds = 1;
+struct shared *sh;
+
+double now_s() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// A publisher or subscriber that cannot go on. The others may be waiting
+// for it to get ready or done, so they are told to stop waiting.
+void fail() {
+    sh->failed = 1;
+    exit(EXIT_FAILURE);
+}
+
+// The model: record seq of publisher pub is its id and seq followed by a
+// body whose length and bytes follow from both. Returns the record length.
+int model_record(unsigned int pub, unsigned int seq, unsigned char *rec) {
+    int len = 2 * sizeof(unsigned int) + (pub * 7 + seq) % MAX_BODY + 1;
+    int i;
+
+    memcpy(rec, &pub, sizeof(pub));
+    memcpy(rec + sizeof(pub), &seq, sizeof(seq));
+    for (i = 2 * sizeof(unsigned int); i < len; i++) {
+        rec[i] = (unsigned char) (pub * 31 + seq * 17 + i);
+    }
+    return len;
+}
+
+void publisher(int minor, int pub) {
+    unsigned char rec[2 * sizeof(unsigned int) + MAX_BODY];
+    unsigned int seq = 0;
+    int fd = open_minor(FIRST_MINOR + minor);
+
+    if (fd < 0 || ioctl(fd, SET_TYPE, TYPE_PUB)) {
+        fail();
+    }
+    while (sh->ready < nr_minors * nr_subs) {
+        if (sh->failed) {
+            fail();
+        }
+        sched_yield();
+    }
+    while (!sh->stop) {
+        int len = model_record(pub, seq, rec);
+        if (write(fd, rec, len) == len) {
+            seq++;
+            sh->published[minor][pub] = seq;
+        } else if (errno == EAGAIN) {
+            // the lane waits for the slowest subscriber
+            sched_yield();
+        } else {
+            fail();
+        }
+    }
+    close(fd);
+    __sync_fetch_and_add(&sh->done, 1);
+    exit(EXIT_SUCCESS);
+}
+
+// Reads until every record published on the minor arrived, checking each one
+// against the model: in order per publisher, none lost, none repeated, the
+// driver's sequence numbers without gaps.
+void subscriber(int minor) {
+    unsigned char buf[READ_SIZE];
+    unsigned char expected[2 * sizeof(unsigned int) + MAX_BODY];
+    unsigned int next[MAX_PUBS];
+    unsigned int next_seq = 0;
+    unsigned long received = 0;
+    int first = 1;
+    double idle_since = 0;
+    int fd = open_minor(FIRST_MINOR + minor);
+    int p;
+
+    if (fd < 0 || ioctl(fd, SET_TYPE, TYPE_SUB) || ioctl(fd, SET_READ_FRAMED, 1)) {
+        fail();
+    }
+    memset(next, 0, sizeof(next));
+    __sync_fetch_and_add(&sh->ready, 1);
+
+    for (;;) {
+        int ret = read(fd, buf, sizeof(buf));
+        int pos = 0;
+
+        if (sh->failed) {
+            fail();
+        }
+        if (ret < 0 && errno != EAGAIN) {
+            fail();
+        }
+        if (ret <= 0) {
+            if (sh->done == nr_minors * nr_pubs) {
+                int all = 1;
+                for (p = 0; p < nr_pubs; p++) {
+                    all &= next[p] == sh->published[minor][p];
+                }
+                if (all) {
+                    break;
+                }
+                if (idle_since == 0) {
+                    idle_since = now_s();
+                } else if (now_s() - idle_since > DRAIN_TIMEOUT) {
+                    fprintf(stderr, "minor %d: records lost\n", FIRST_MINOR + minor);
+                    fail();
+                }
+            }
+            sched_yield();
+            continue;
+        }
+        idle_since = 0;
+        while (pos < ret) {
+            struct pubsub_frame frame;
+            unsigned int pub, seq;
+
+            memcpy(&frame, buf + pos, sizeof(frame));
+            pos += sizeof(frame);
+            if (frame.len < 2 * sizeof(unsigned int) || pos + frame.len > ret) {
+                fprintf(stderr, "minor %d: bad frame\n", FIRST_MINOR + minor);
+                fail();
+            }
+            if (!first && frame.seq != next_seq) {
+                fprintf(stderr, "minor %d: seq %u after %u\n", FIRST_MINOR + minor, frame.seq, next_seq - 1);
+                fail();
+            }
+            first = 0;
+            next_seq = frame.seq + 1;
+            memcpy(&pub, buf + pos, sizeof(pub));
+            memcpy(&seq, buf + pos + sizeof(pub), sizeof(seq));
+            if (pub >= nr_pubs || seq != next[pub] ||
+                model_record(pub, seq, expected) != frame.len || memcmp(expected, buf + pos, frame.len)) {
+                fprintf(stderr, "minor %d: publisher %u record %u is not the expected %u\n",
+                        FIRST_MINOR + minor, pub, seq, pub < nr_pubs ? next[pub] : 0);
+                fail();
+            }
+            next[pub]++;
+            received++;
+            pos += frame.len;
+        }
+    }
+    close(fd);
+    __sync_fetch_and_add(&sh->received, received);
+    exit(EXIT_SUCCESS);
+}
+
+void pin_to_cpus(int nr_cpus) {
+    cpu_set_t set;
+    int i;
+
+    CPU_ZERO(&set);
+    for (i = 0; i < nr_cpus; i++) {
+        CPU_SET(i, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+// One run on the first nr_cpus CPUs. Returns the records subscribers
+// received per second.
+double run(int nr_cpus) {
+    int setup_fd[MAX_MINORS];
+    unsigned long published = 0;
+    int failed = 0;
+    double start;
+    int m, i, status;
+
+    memset(sh, 0, sizeof(*sh));
+    pin_to_cpus(nr_cpus);
+    // framed minors with room, kept open so the settings last the whole run
+    for (m = 0; m < nr_minors; m++) {
+        setup_fd[m] = open_minor(FIRST_MINOR + m);
+        assert_test(setup_fd[m] >= 0 && ioctl(setup_fd[m], SET_CAPACITY, CAPACITY) == 0 &&
+                    ioctl(setup_fd[m], SET_FRAMED, 1) == 0, "Set up a framed minor");
+    }
+    for (m = 0; m < nr_minors; m++) {
+        for (i = 0; i < nr_subs; i++) {
+            if (fork() == 0) {
+                subscriber(m);
+            }
+        }
+        for (i = 0; i < nr_pubs; i++) {
+            if (fork() == 0) {
+                publisher(m, i);
+            }
+        }
+    }
+    while (sh->ready < nr_minors * nr_subs && !sh->failed) {
+        sched_yield();
+    }
+    start = now_s();
+    if (!sh->failed) {
+        sleep(seconds);
+    }
+    sh->stop = 1;
+    while (wait(&status) > 0) {
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    for (m = 0; m < nr_minors; m++) {
+        for (i = 0; i < nr_pubs; i++) {
+            published += sh->published[m][i];
+        }
+        close(setup_fd[m]);
+    }
+    assert_test(!failed && !sh->failed, "Every subscriber received exactly the model's records");
+    assert_test(sh->received == published * nr_subs, "Every record reached every subscriber of its minor");
+    return sh->received / (now_s() - start);
+}
+
+int main(int argc, char *argv[]) {
+    int max_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+    int opt, cpus;
+
+    while ((opt = getopt(argc, argv, "m:p:s:d:c:")) != -1) {
+        switch (opt) {
+        case 'm': nr_minors = atoi(optarg); break;
+        case 'p': nr_pubs = atoi(optarg); break;
+        case 's': nr_subs = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        case 'c': max_cpus = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-m minors] [-p pubs] [-s subs] [-d seconds] [-c max cpus]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (nr_minors < 1 || nr_minors > MAX_MINORS || nr_pubs < 1 || nr_pubs > MAX_PUBS || nr_subs < 1 ||
+        seconds < 1 || max_cpus < 1) {
+        fprintf(stderr, "at most %d minors and %d publishers per minor\n", MAX_MINORS, MAX_PUBS);
+        return EXIT_FAILURE;
+    }
+
+    printf("\nRunning PubSub stress test: %d minors, %d publishers and %d subscribers each, %ds per run\n",
+           nr_minors, nr_pubs, nr_subs, seconds);
+    printf("==========================================================================================\n\n");
+
+    sh = mmap(NULL, sizeof(*sh), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert_test(sh != MAP_FAILED, "Map the shared counters");
+
+    // 1, 2, 4... CPUs, and all of them last
+    for (cpus = 1; ; cpus *= 2) {
+        double rate;
+
+        if (cpus > max_cpus) {
+            cpus = max_cpus;
+        }
+        rate = run(cpus);
+        if (base == 0) {
+            base = rate;
+        }
+        printf("cpus %3d: %12.0f records/s delivered, %.2fx one cpu\n", cpus, rate, rate / base);
+        if (cpus == max_cpus) {
+            break;
+        }
+    }
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+
+#define DEVICE_PATH "/dev/pubsub"
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int open_member(const char *group) {
+    char name[GROUP_NAME_LEN];
+    int fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(fd >= 0, "Open group member");
+    assert_test(ioctl(fd, SET_TYPE, TYPE_GROUP) == 0, "Set type to TYPE_GROUP");
+    memset(name, 0, sizeof(name));
+    strncpy(name, group, GROUP_NAME_LEN - 1);
+    assert_test(ioctl(fd, JOIN_GROUP, name) == 0, "Join group");
+    return fd;
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    int ret;
+
+    printf("\nRunning PubSub consumer group tests\n");
+    printf("===================================\n\n");
+
+    int pub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(pub_fd >= 0, "Open publisher");
+    assert_test(ioctl(pub_fd, SET_TYPE, TYPE_PUB) == 0, "Set type to TYPE_PUB");
+
+    // a group file cannot read before joining, and cannot join twice
+    int lone_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(lone_fd, SET_TYPE, TYPE_GROUP) == 0, "Set type to TYPE_GROUP");
+    ret = read(lone_fd, buf, 10);
+    assert_test(ret == -1 && errno == EPERM, "Read before JOIN_GROUP returns EPERM");
+    close(lone_fd);
+
+    int sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set type to TYPE_SUB");
+    int a_fd = open_member("workers");
+    int b_fd = open_member("workers");
+    ret = ioctl(a_fd, JOIN_GROUP, "workers");
+    assert_test(ret == -1 && errno == EPERM, "Joining twice returns EPERM");
+
+    memset(buf, 'W', 100);
+    assert_test(write(pub_fd, buf, 100) == 100, "Publisher writes 100 bytes");
+
+    // the members share one cursor: between them they see the 100 bytes once
+    ret = read(a_fd, buf, 60);
+    assert_test(ret == 60, "Member A reads 60 bytes");
+    ret = read(b_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 40, "Member B gets the remaining 40 bytes");
+    ret = read(a_fd, buf, BUFFER_SIZE);
+    assert_test(ret == -1 && errno == EAGAIN, "Member A has nothing left");
+
+    // the plain subscriber still gets everything
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 100, "Subscriber reads all 100 bytes");
+
+    // group and subscriber are done, so the whole buffer is free again
+    memset(buf, 'X', BUFFER_SIZE);
+    assert_test(write(pub_fd, buf, BUFFER_SIZE) == BUFFER_SIZE, "Buffer reset after group and subscriber finished");
+
+    ret = read(b_fd, buf, BUFFER_SIZE);
+    assert_test(ret == BUFFER_SIZE, "Member B reads the new buffer");
+    ret = read(a_fd, buf, BUFFER_SIZE);
+    assert_test(ret == -1 && errno == EAGAIN, "Member A sees it was consumed");
+
+    // the last member leaving drops the group from the subscriber count
+    close(a_fd);
+    close(b_fd);
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == BUFFER_SIZE, "Subscriber reads the new buffer");
+    assert_test(write(pub_fd, buf, 10) == 10, "Buffer reset once the only subscriber finished");
+
+    close(sub_fd);
+    close(pub_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "pubsub.h"
+
+#define DEVICE_PATH "/dev/pubsub"
+#define BUFFER_SIZE 1000
+
+#define GREEN "\033[32m"
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+void assert_test(int condition, const char *test_description) {
+    if (condition) {
+        printf(GREEN "PASS: %s\n" RESET, test_description);
+    } else {
+        printf(RED "FAIL: %s\n" RESET, test_description);
+        printf("Error: %s (errno=%d)\n", strerror(errno), errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main() {
+    char buf[BUFFER_SIZE];
+    int ret;
+
+    printf("\nRunning PubSub priority lane tests\n");
+    printf("==================================\n\n");
+
+    int bulk_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(bulk_fd, SET_TYPE, TYPE_PUB) == 0, "Set bulk publisher type");
+    int ctl_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(ctl_fd, SET_TYPE, TYPE_PUB) == 0, "Set control publisher type");
+    int sub_fd = open(DEVICE_PATH, O_RDWR);
+    assert_test(ioctl(sub_fd, SET_TYPE, TYPE_SUB) == 0, "Set subscriber type");
+
+    ret = ioctl(sub_fd, SET_LANES, MAX_LANES + 1);
+    assert_test(ret == -1 && errno == EINVAL, "Too many lanes returns EINVAL");
+    assert_test(ioctl(sub_fd, SET_LANES, 2) == 0, "Minor gets two lanes");
+    ret = ioctl(sub_fd, SET_PRIORITY, 0);
+    assert_test(ret == -1 && errno == EPERM, "Subscriber cannot set a priority");
+    assert_test(ioctl(ctl_fd, SET_PRIORITY, 0) == 0, "Control publisher uses lane 0");
+
+    // fill the bulk lane: control messages must still get through
+    memset(buf, 'D', BUFFER_SIZE);
+    assert_test(write(bulk_fd, buf, BUFFER_SIZE) == BUFFER_SIZE, "Bulk lane filled");
+    ret = write(bulk_fd, buf, 1);
+    assert_test(ret == -1 && errno == EAGAIN, "Bulk lane is full");
+    memset(buf, 'C', 10);
+    assert_test(write(ctl_fd, buf, 10) == 10, "Control write goes through");
+
+    ret = ioctl(sub_fd, SET_LANES, 1);
+    assert_test(ret == -1 && errno == EBUSY, "Lane count cannot change while holding data");
+
+    // the control lane is drained first, one lane per read
+    memset(buf, 0, BUFFER_SIZE);
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == 10 && buf[0] == 'C', "First read returns the control lane");
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == BUFFER_SIZE && buf[0] == 'D', "Second read returns the bulk lane");
+    ret = read(sub_fd, buf, BUFFER_SIZE);
+    assert_test(ret == -1 && errno == EAGAIN, "Both lanes drained");
+
+    assert_test(write(bulk_fd, buf, 100) == 100, "Bulk lane was reset");
+    assert_test(read(sub_fd, buf, BUFFER_SIZE) == 100, "Read bulk data again");
+    assert_test(ioctl(sub_fd, SET_LANES, 1) == 0, "Back to a single lane once empty");
+
+    close(sub_fd);
+    close(ctl_fd);
+    close(bulk_fd);
+
+    printf(GREEN "\nAll tests passed successfully!\n" RESET);
+    return 0;
+}
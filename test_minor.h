@@ -0,0 +1,36 @@
+#ifndef _TEST_MINOR_H_
+#define _TEST_MINOR_H_
+
+// Minors other than /dev/pubsub's for the tests: their nodes are created
+// next to it, with its major.
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#ifndef DEVICE_PATH
+#define DEVICE_PATH "/dev/pubsub"
+#endif
+
+// the node of another minor of the driver, NULL when the driver has no node
+static inline const char *minor_path(int minor) {
+    static char path[64];
+    struct stat st;
+
+    if (stat(DEVICE_PATH, &st) != 0) {
+        return NULL;
+    }
+    sprintf(path, DEVICE_PATH "%d", minor);
+    mknod(path, S_IFCHR | 0666, makedev(major(st.st_rdev), minor));
+    return path;
+}
+
+static inline int open_minor(int minor) {
+    const char *path = minor_path(minor);
+
+    return path != NULL ? open(path, O_RDWR) : -1;
+}
+
+#endif